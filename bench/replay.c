@@ -0,0 +1,481 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "page_manager.h"
+
+
+/*
+ * Headless replay benchmark: drives the page manager through a trace of navigation operations on synthetic pages and
+ * reports per operation latency percentiles, allocations and the peak stack depth.
+ *
+ * Traces are text files with one operation per line (`#` starts a comment):
+ *
+ *     push <page>     pman_change_page
+ *     back            pman_back (skipped with a single page on the stack)
+ *     swap <page>     pman_swap_page
+ *     rebase <page>   pman_rebase_page
+ *     reset <page>    pman_reset_to_page_id
+ *     event <value>   pman_event with a user event
+ *
+ * where <page> is an id between 0 and NUM_PAGES - 1. With `--generate <count> [seed]` a deterministic pseudo random
+ * trace is used instead of a file (`--dump` prints it in the same format).
+ *
+ * Allocations and stack depth do not depend on timing, so they can be checked against a baseline: with
+ * `--max-allocs <n>`, `--max-live <n>` (allocations not freed by `pman_deinit`) and `--max-peak-depth <n>` the run
+ * fails if the result is above the limit.
+ */
+
+
+#define NUM_PAGES        8
+#define STATE_SIZE       48
+#define DEFAULT_SEED     1
+#define GENERATED_DEPTH  12
+#define INITIAL_CAPACITY 256
+#define NO_LIMIT         SIZE_MAX
+
+
+typedef enum {
+    OP_PUSH = 0,
+    OP_BACK,
+    OP_SWAP,
+    OP_REBASE,
+    OP_RESET,
+    OP_EVENT,
+    OP_NUM,
+} op_kind_t;
+
+
+typedef struct {
+    op_kind_t kind;
+    int       arg;
+} op_t;
+
+
+typedef struct {
+    op_t  *items;
+    size_t count;
+    size_t capacity;
+} trace_t;
+
+
+typedef struct {
+    uint64_t *samples;
+    size_t    count;
+    size_t    capacity;
+    size_t    skipped;
+    size_t    allocs;
+    size_t    frees;
+} op_stats_t;
+
+
+typedef struct {
+    uint32_t counter;
+    uint8_t  data[STATE_SIZE];
+} page_state_t;
+
+
+static void      *create_page(pman_handle_t handle, void *extra);
+static pman_msg_t process_page_event(pman_handle_t handle, void *state, pman_event_t event);
+static void      *counting_alloc(size_t size);
+static void       counting_free(void *ptr);
+#ifndef PMAN_PAGE_STACK_DEPTH
+static void *counting_realloc(void *ptr, size_t size);
+#endif
+static int      load_trace(trace_t *trace, const char *path);
+static void     generate_trace(trace_t *trace, size_t count, uint32_t seed);
+static void     dump_trace(const trace_t *trace);
+static void     append_op(trace_t *trace, op_kind_t kind, int arg);
+static int      run_op(pman_t *pman, op_t op);
+static void     add_sample(op_stats_t *stats, uint64_t sample);
+static uint64_t percentile(const op_stats_t *stats, unsigned percent);
+static int      compare_samples(const void *first, const void *second);
+static uint64_t now_ns(void);
+static uint8_t  check_limit(const char *name, size_t value, size_t limit);
+
+
+static const char *const op_names[OP_NUM] = {"push", "back", "swap", "rebase", "reset", "event"};
+
+static pman_page_t pages[NUM_PAGES];
+
+static size_t allocs      = 0;
+static size_t frees       = 0;
+static size_t alloc_bytes = 0;
+
+
+int main(int argc, char *argv[]) {
+    trace_t     trace         = {0};
+    op_stats_t  stats[OP_NUM] = {0};
+    size_t      iterations    = 1;
+    uint8_t     dump          = 0;
+    uint8_t     generated     = 0;
+    const char *path          = NULL;
+    size_t      max_allocs    = NO_LIMIT;
+    size_t      max_live      = NO_LIMIT;
+    size_t      max_depth     = NO_LIMIT;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc) {
+            size_t   count = strtoul(argv[++i], NULL, 10);
+            uint32_t seed  = i + 1 < argc && argv[i + 1][0] != '-' ? strtoul(argv[++i], NULL, 10) : DEFAULT_SEED;
+            generate_trace(&trace, count, seed);
+            generated = 1;
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dump") == 0) {
+            dump = 1;
+        } else if (strcmp(argv[i], "--max-allocs") == 0 && i + 1 < argc) {
+            max_allocs = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-live") == 0 && i + 1 < argc) {
+            max_live = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-peak-depth") == 0 && i + 1 < argc) {
+            max_depth = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+
+    if (!generated && (path == NULL || load_trace(&trace, path) != 0)) {
+        fprintf(stderr,
+                "usage: %s <trace> | --generate <count> [seed] [--iterations <n>] [--dump] [--max-allocs <n>] "
+                "[--max-live <n>] [--max-peak-depth <n>]\n",
+                argv[0]);
+        return 1;
+    }
+    if (dump) {
+        dump_trace(&trace);
+        return 0;
+    }
+
+    for (int i = 0; i < NUM_PAGES; i++) {
+        pages[i] = (pman_page_t){
+            .id            = i,
+            .create        = create_page,
+            .process_event = process_page_event,
+        };
+    }
+
+    pman_set_heap_allocator(counting_alloc, counting_free);
+
+    pman_t pman;
+    pman_init(&pman, NULL, NULL, NULL, NULL);
+#ifndef PMAN_PAGE_STACK_DEPTH
+    pman_set_page_stack_allocator(&pman, counting_realloc, counting_free);
+#endif
+    pman_set_registry(&pman, pages, NUM_PAGES);
+
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        for (size_t i = 0; i < trace.count; i++) {
+            op_t        op            = trace.items[i];
+            size_t      allocs_before = allocs;
+            size_t      frees_before  = frees;
+            uint64_t    start         = now_ns();
+            int         result        = run_op(&pman, op);
+            uint64_t    elapsed       = now_ns() - start;
+            op_stats_t *op_stats      = &stats[op.kind];
+
+            if (result != 0) {
+                op_stats->skipped++;
+                continue;
+            }
+            add_sample(op_stats, elapsed);
+            op_stats->allocs += allocs - allocs_before;
+            op_stats->frees += frees - frees_before;
+        }
+    }
+
+    printf("%-8s %10s %10s %10s %10s %10s %10s %10s\n", "op", "count", "skipped", "p50 ns", "p95 ns", "p99 ns",
+           "allocs", "frees");
+    for (size_t i = 0; i < OP_NUM; i++) {
+        qsort(stats[i].samples, stats[i].count, sizeof(uint64_t), compare_samples);
+        printf("%-8s %10zu %10zu %10llu %10llu %10llu %10zu %10zu\n", op_names[i], stats[i].count, stats[i].skipped,
+               (unsigned long long)percentile(&stats[i], 50), (unsigned long long)percentile(&stats[i], 95),
+               (unsigned long long)percentile(&stats[i], 99), stats[i].allocs, stats[i].frees);
+        free(stats[i].samples);
+    }
+    size_t peak_depth = pman_get_peak_depth(&pman, 0);
+    // Whatever is still live after this is a leak
+    pman_deinit(&pman);
+
+    printf("\nallocations: %zu (%zu bytes), frees: %zu, live: %zu\n", allocs, alloc_bytes, frees, allocs - frees);
+    printf("peak depth: %zu\n", peak_depth);
+
+    uint8_t failed = check_limit("allocations", allocs, max_allocs);
+    failed |= check_limit("live allocations", allocs - frees, max_live);
+    failed |= check_limit("peak depth", peak_depth, max_depth);
+
+    free(trace.items);
+    return failed ? 1 : 0;
+}
+
+
+/**
+ * @brief Compares a result with its baseline
+ *
+ * @param name
+ * @param value
+ * @param limit NO_LIMIT if unchecked
+ * @return uint8_t 1 if the value is above the limit
+ */
+static uint8_t check_limit(const char *name, size_t value, size_t limit) {
+    if (limit != NO_LIMIT && value > limit) {
+        fprintf(stderr, "%s: %zu, above the limit of %zu\n", name, value, limit);
+        return 1;
+    }
+    return 0;
+}
+
+
+static void *create_page(pman_handle_t handle, void *extra) {
+    (void)extra;
+    page_state_t *state = pman_arena_alloc(handle, sizeof(page_state_t));
+    assert(state != NULL);
+    memset(state, 0, sizeof(page_state_t));
+    return state;
+}
+
+
+static pman_msg_t process_page_event(pman_handle_t handle, void *state, pman_event_t event) {
+    (void)handle;
+    page_state_t *pstate = state;
+
+    if (event.tag == PMAN_EVENT_TAG_USER) {
+        uintptr_t value = (uintptr_t)event.as.user;
+        pstate->counter += (uint32_t)value;
+        pstate->data[value % STATE_SIZE]++;
+    }
+
+    return PMAN_MSG_NULL;
+}
+
+
+/**
+ * @brief Applies an operation of the trace
+ *
+ * @param pman
+ * @param op
+ * @return int 0 if it ran, -1 if it was skipped because it doesn't apply to the current stack
+ */
+static int run_op(pman_t *pman, op_t op) {
+    size_t depth = pman_page_stack_size(&pman->page_stack);
+
+    if (op.kind != OP_PUSH && depth == 0) {
+        return -1;
+    }
+
+    switch (op.kind) {
+        case OP_PUSH:
+#if !PMAN_BOUNDED_HISTORY
+            if (pman_page_stack_is_full(&pman->page_stack)) {
+                return -1;
+            }
+#endif
+            pman_change_page(pman, pages[op.arg]);
+            break;
+
+        case OP_BACK:
+            if (depth < 2) {
+                return -1;
+            }
+            pman_back(pman);
+            break;
+
+        case OP_SWAP:
+            pman_swap_page(pman, pages[op.arg]);
+            break;
+
+        case OP_REBASE:
+            pman_rebase_page(pman, pages[op.arg]);
+            break;
+
+        case OP_RESET:
+            pman_reset_to_page_id(pman, op.arg, NULL);
+            break;
+
+        case OP_EVENT:
+            pman_event(pman, PMAN_USER_EVENT((void *)(uintptr_t)op.arg));
+            break;
+
+        default:
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int load_trace(trace_t *trace, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return -1;
+    }
+
+    char   line[128];
+    size_t number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[16] = {0};
+        int  arg      = 0;
+        number++;
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        int fields = sscanf(line, "%15s %d", name, &arg);
+        if (fields <= 0) {
+            continue;
+        }
+
+        size_t kind = 0;
+        while (kind < OP_NUM && strcmp(name, op_names[kind]) != 0) {
+            kind++;
+        }
+
+        uint8_t needs_page = kind == OP_PUSH || kind == OP_SWAP || kind == OP_REBASE || kind == OP_RESET;
+        if (kind == OP_NUM || (kind != OP_BACK && fields < 2) || (needs_page && (arg < 0 || arg >= NUM_PAGES))) {
+            fprintf(stderr, "%s:%zu: invalid operation\n", path, number);
+            fclose(file);
+            return -1;
+        }
+        append_op(trace, (op_kind_t)kind, arg);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+
+/**
+ * @brief Generates a navigation session: mostly pushes and backs around GENERATED_DEPTH pages deep, interleaved with
+ * bursts of user events and occasional swaps, rebases and resets. The same seed always gives the same trace.
+ *
+ * @param trace
+ * @param count
+ * @param seed
+ */
+static void generate_trace(trace_t *trace, size_t count, uint32_t seed) {
+    uint32_t random = seed != 0 ? seed : DEFAULT_SEED;
+    size_t   depth  = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        // xorshift32
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+
+        unsigned roll = random % 100;
+        int      page = (int)((random >> 8) % NUM_PAGES);
+
+        if (depth == 0 || (roll < 30 && depth < GENERATED_DEPTH)) {
+            append_op(trace, OP_PUSH, page);
+            depth++;
+        } else if (roll < 55 && depth > 1) {
+            append_op(trace, OP_BACK, 0);
+            depth--;
+        } else if (roll < 62) {
+            append_op(trace, OP_SWAP, page);
+        } else if (roll < 64) {
+            append_op(trace, OP_REBASE, page);
+            depth = 1;
+        } else if (roll < 67) {
+            // The actual depth after a reset depends on the stack, the next backs are skipped if it is shallower
+            append_op(trace, OP_RESET, page);
+        } else {
+            append_op(trace, OP_EVENT, (int)(random >> 16));
+        }
+    }
+}
+
+
+static void dump_trace(const trace_t *trace) {
+    for (size_t i = 0; i < trace->count; i++) {
+        if (trace->items[i].kind == OP_BACK) {
+            printf("%s\n", op_names[trace->items[i].kind]);
+        } else {
+            printf("%s %d\n", op_names[trace->items[i].kind], trace->items[i].arg);
+        }
+    }
+}
+
+
+static void append_op(trace_t *trace, op_kind_t kind, int arg) {
+    if (trace->count == trace->capacity) {
+        trace->capacity = trace->capacity > 0 ? trace->capacity * 2 : INITIAL_CAPACITY;
+        trace->items    = realloc(trace->items, trace->capacity * sizeof(op_t));
+        assert(trace->items != NULL);
+    }
+    trace->items[trace->count++] = (op_t){.kind = kind, .arg = arg};
+}
+
+
+static void add_sample(op_stats_t *stats, uint64_t sample) {
+    if (stats->count == stats->capacity) {
+        stats->capacity = stats->capacity > 0 ? stats->capacity * 2 : INITIAL_CAPACITY;
+        stats->samples  = realloc(stats->samples, stats->capacity * sizeof(uint64_t));
+        assert(stats->samples != NULL);
+    }
+    stats->samples[stats->count++] = sample;
+}
+
+
+/**
+ * @brief Nearest rank percentile of sorted samples
+ *
+ * @param stats
+ * @param percent
+ * @return uint64_t 0 if there are no samples
+ */
+static uint64_t percentile(const op_stats_t *stats, unsigned percent) {
+    if (stats->count == 0) {
+        return 0;
+    }
+    size_t rank = (stats->count * percent + 99) / 100;
+    return stats->samples[rank > 0 ? rank - 1 : 0];
+}
+
+
+static int compare_samples(const void *first, const void *second) {
+    uint64_t a = *(const uint64_t *)first;
+    uint64_t b = *(const uint64_t *)second;
+    return (a > b) - (a < b);
+}
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+static void *counting_alloc(size_t size) {
+    allocs++;
+    alloc_bytes += size;
+    return malloc(size);
+}
+
+
+static void counting_free(void *ptr) {
+    if (ptr != NULL) {
+        frees++;
+    }
+    free(ptr);
+}
+
+
+#ifndef PMAN_PAGE_STACK_DEPTH
+static void *counting_realloc(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        allocs++;
+    }
+    alloc_bytes += size;
+    return realloc(ptr, size);
+}
+#endif
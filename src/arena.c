@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include "arena.h"
+
+
+#define ALIGN(size)  ((((size) + sizeof(uint64_t) - 1) / sizeof(uint64_t)) * sizeof(uint64_t))
+#define HEADER_SIZE  ALIGN(sizeof(pman_arena_chunk_t))
+#define DATA(chunk) (((uint8_t *)(chunk)) + HEADER_SIZE)
+
+
+void pman_arena_init(pman_arena_t *arena) {
+    arena->head = NULL;
+}
+
+
+/**
+ * @brief Allocates a block from the arena
+ *
+ * @param arena
+ * @param size
+ * @param chunk_size size of the chunks requested to the heap; bigger blocks get a dedicated chunk
+ * @param alloc_fn heap allocation function
+ * @return void* NULL if the heap is exhausted
+ */
+void *pman_arena_take(pman_arena_t *arena, size_t size, size_t chunk_size, void *(*alloc_fn)(size_t)) {
+    size = ALIGN(size);
+
+    pman_arena_chunk_t *head = arena->head;
+    if (head != NULL && head->size - head->used >= size) {
+        void *block = DATA(head) + head->used;
+        head->used += size;
+        return block;
+    }
+
+    size_t              data_size = size > chunk_size ? size : chunk_size;
+    pman_arena_chunk_t *chunk     = alloc_fn(HEADER_SIZE + data_size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->size = data_size;
+    chunk->used = size;
+
+    if (head != NULL && size > chunk_size / 2) {
+        // A large block would waste most of the current chunk; keep filling that one instead
+        chunk->next = head->next;
+        head->next  = chunk;
+    } else {
+        chunk->next = head;
+        arena->head = chunk;
+    }
+
+    return DATA(chunk);
+}
+
+
+/**
+ * @brief Frees all blocks, keeping the current chunk for reuse
+ *
+ * @param arena
+ * @param free_fn heap deallocation function
+ */
+void pman_arena_reset(pman_arena_t *arena, void (*free_fn)(void *)) {
+    if (arena->head == NULL) {
+        return;
+    }
+
+    pman_arena_chunk_t *head = arena->head;
+    arena->head              = head->next;
+    pman_arena_release(arena, free_fn);
+
+    head->next  = NULL;
+    head->used  = 0;
+    arena->head = head;
+}
+
+
+/**
+ * @brief Frees all blocks and chunks
+ *
+ * @param arena
+ * @param free_fn heap deallocation function
+ */
+void pman_arena_release(pman_arena_t *arena, void (*free_fn)(void *)) {
+    pman_arena_chunk_t *chunk = arena->head;
+
+    while (chunk != NULL) {
+        pman_arena_chunk_t *next = chunk->next;
+        free_fn(chunk);
+        chunk = next;
+    }
+
+    arena->head = NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef PMAN_ARENA_H_INCLUDED
+#define PMAN_ARENA_H_INCLUDED
+
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+typedef struct pman_arena_chunk {
+    struct pman_arena_chunk *next;
+    size_t                   size;
+    size_t                   used;
+} pman_arena_chunk_t;
+
+
+/**
+ * @brief Bump allocator over a list of heap chunks, freed all at once
+ *
+ */
+typedef struct {
+    // The head chunk is the one being filled
+    pman_arena_chunk_t *head;
+} pman_arena_t;
+
+
+void  pman_arena_init(pman_arena_t *arena);
+void *pman_arena_take(pman_arena_t *arena, size_t size, size_t chunk_size, void *(*alloc_fn)(size_t));
+void  pman_arena_reset(pman_arena_t *arena, void (*free_fn)(void *));
+void  pman_arena_release(pman_arena_t *arena, void (*free_fn)(void *));
+
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef PMAN_COROUTINE_H_INCLUDED
+#define PMAN_COROUTINE_H_INCLUDED
+
+
+#include <stdint.h>
+#include "page.h"
+
+
+/*
+ * Stackless coroutines for `process_event`, so that a handler waiting for jobs (or anything else) reads sequentially.
+ * The resume point is kept in a `pman_coroutine_t` in the page state: 0 runs the body from the top at the next event,
+ * PMAN_CO_DONE (where PMAN_CO_END parks it) skips the body until PMAN_CO_RESET. Local variables are not preserved
+ * across awaits and the body cannot contain `switch` statements. While the coroutine waits every event that reaches it
+ * returns PMAN_MSG_NULL, so events that should be handled regardless go before PMAN_CO_BEGIN.
+ *
+ *     void *create(pman_handle_t handle, void *extra) {
+ *         struct page_data *pdata = ...;
+ *         pdata->co               = PMAN_CO_DONE;
+ *         return pdata;
+ *     }
+ *
+ *     pman_msg_t process_event(pman_handle_t handle, void *state, pman_event_t event) {
+ *         struct page_data *pdata = state;
+ *
+ *         if (event.tag == PMAN_EVENT_TAG_USER && event.as.user == MSG_SAVE && PMAN_CO_IS_DONE(&pdata->co)) {
+ *             PMAN_CO_RESET(&pdata->co);
+ *         }
+ *
+ *         PMAN_CO_BEGIN(&pdata->co);
+ *         pman_start_job(handle, JOB_SAVE, save_file, pdata->file, NULL);
+ *         PMAN_CO_AWAIT_JOB(&pdata->co, event, JOB_SAVE);
+ *         pdata->saved = event.as.job->result != NULL;
+ *         PMAN_CO_END(&pdata->co);
+ *
+ *         return PMAN_MSG_NULL;
+ *     }
+ */
+
+
+typedef uint16_t pman_coroutine_t;
+
+
+// Resume point of a finished coroutine; awaits are identified by their line number, which must stay below it
+#define PMAN_CO_DONE UINT16_MAX
+
+
+#define PMAN_CO_BEGIN(co)                                                                                              \
+    switch (*(co)) {                                                                                                   \
+        case 0:
+
+// Returns PMAN_MSG_NULL until `cond` holds when the handler is called again
+#define PMAN_CO_AWAIT(co, cond)                                                                                        \
+    do {                                                                                                               \
+        *(co) = __LINE__;                                                                                              \
+        case __LINE__:                                                                                                 \
+            if (!(cond)) {                                                                                             \
+                return PMAN_MSG_NULL;                                                                                  \
+            }                                                                                                          \
+    } while (0)
+
+#if PMAN_ASYNC_JOBS
+// Returns PMAN_MSG_NULL until `event` is the completion of the job started with `job_id`
+#define PMAN_CO_AWAIT_JOB(co, event, job_id)                                                                           \
+    PMAN_CO_AWAIT(co, (event).tag == PMAN_EVENT_TAG_JOB && (event).as.job->id == (job_id))
+#endif
+
+// The coroutine starts over at the next event
+#define PMAN_CO_RESET(co) (*(co) = 0)
+
+#define PMAN_CO_IS_DONE(co) (*(co) == PMAN_CO_DONE)
+
+// Parks the coroutine in PMAN_CO_DONE, where further events skip the body
+#define PMAN_CO_END(co)                                                                                                \
+    *(co) = PMAN_CO_DONE;                                                                                              \
+    case PMAN_CO_DONE:;                                                                                                \
+        }
+
+
+#endif
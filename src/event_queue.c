@@ -0,0 +1,107 @@
+#include <stdint.h>
+#include "event_queue.h"
+
+
+#if PMAN_EVENT_QUEUE_SIZE > 0
+
+
+#define MASK (PMAN_EVENT_QUEUE_SIZE - 1)
+
+
+void pman_event_queue_init(pman_event_queue_t *queue) {
+    for (size_t i = 0; i < PMAN_EVENT_QUEUE_SIZE; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+        queue->cells[i].user = NULL;
+    }
+
+    atomic_init(&queue->enqueue_pos, 0);
+    queue->dequeue_pos = 0;
+    atomic_init(&queue->posted, 0);
+    atomic_init(&queue->overflows, 0);
+    queue->high_water = 0;
+    queue->coalesced  = 0;
+}
+
+
+/**
+ * @brief Adds a payload to the queue. Safe to call from any thread or interrupt at the same time.
+ * Each cell carries a sequence number that tells producers whether it is free for the current lap and the consumer
+ * whether it has been filled.
+ *
+ * @param queue
+ * @param user
+ * @return int 0 on success, -1 if the queue is full
+ */
+int pman_event_queue_push(pman_event_queue_t *queue, void *user) {
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        pman_event_queue_cell_t *cell     = &queue->cells[pos & MASK];
+        size_t                   sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t                 diff     = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->user = user;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                atomic_fetch_add_explicit(&queue->posted, 1, memory_order_relaxed);
+                return 0;
+            }
+            // `pos` was reloaded by the failed exchange
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&queue->overflows, 1, memory_order_relaxed);
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+
+/**
+ * @brief Removes the oldest payload from the queue. Must only be called by the consumer thread.
+ *
+ * @param queue
+ * @param user
+ * @return int 0 on success, -1 if the queue is empty
+ */
+int pman_event_queue_pop(pman_event_queue_t *queue, void **user) {
+    size_t                   pos      = queue->dequeue_pos;
+    pman_event_queue_cell_t *cell     = &queue->cells[pos & MASK];
+    size_t                   sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+
+    if ((intptr_t)sequence - (intptr_t)(pos + 1) < 0) {
+        return -1;
+    }
+
+    size_t pending = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed) - pos;
+    if (pending > queue->high_water) {
+        queue->high_water = pending;
+    }
+
+    *user = cell->user;
+    atomic_store_explicit(&cell->sequence, pos + PMAN_EVENT_QUEUE_SIZE, memory_order_release);
+    queue->dequeue_pos = pos + 1;
+
+    return 0;
+}
+
+
+/**
+ * @brief Reads the queue statistics. Must only be called by the consumer thread.
+ *
+ * @param queue
+ * @param stats
+ */
+void pman_event_queue_get_stats(pman_event_queue_t *queue, pman_event_queue_stats_t *stats) {
+    stats->capacity   = PMAN_EVENT_QUEUE_SIZE;
+    stats->pending    = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed) - queue->dequeue_pos;
+    stats->high_water = queue->high_water;
+    stats->posted     = (uint32_t)atomic_load_explicit(&queue->posted, memory_order_relaxed);
+    stats->overflows  = (uint32_t)atomic_load_explicit(&queue->overflows, memory_order_relaxed);
+    stats->coalesced  = queue->coalesced;
+}
+
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef PMAN_EVENT_QUEUE_H_INCLUDED
+#define PMAN_EVENT_QUEUE_H_INCLUDED
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "page_manager_conf.h"
+
+
+#if PMAN_EVENT_QUEUE_SIZE > 0
+#include <stdatomic.h>
+
+#if (PMAN_EVENT_QUEUE_SIZE & (PMAN_EVENT_QUEUE_SIZE - 1)) != 0
+#error "PMAN_EVENT_QUEUE_SIZE must be a power of 2"
+#endif
+
+
+typedef struct {
+    atomic_size_t sequence;
+    void         *user;
+} pman_event_queue_cell_t;
+
+
+/**
+ * @brief Bounded lock-free multi-producer/single-consumer queue of user event payloads
+ *
+ */
+typedef struct {
+    pman_event_queue_cell_t cells[PMAN_EVENT_QUEUE_SIZE];
+    atomic_size_t           enqueue_pos;
+    size_t                  dequeue_pos;
+
+    atomic_uint_fast32_t posted;
+    atomic_uint_fast32_t overflows;
+    size_t               high_water;
+    // Updated by the consumer when it merges events
+    uint32_t coalesced;
+} pman_event_queue_t;
+
+
+/**
+ * @brief Event queue statistics
+ *
+ */
+typedef struct {
+    size_t   capacity;
+    size_t   pending;
+    size_t   high_water;
+    uint32_t posted;
+    uint32_t overflows;
+    uint32_t coalesced;
+} pman_event_queue_stats_t;
+
+
+void pman_event_queue_init(pman_event_queue_t *queue);
+int  pman_event_queue_push(pman_event_queue_t *queue, void *user);
+int  pman_event_queue_pop(pman_event_queue_t *queue, void **user);
+void pman_event_queue_get_stats(pman_event_queue_t *queue, pman_event_queue_stats_t *stats);
+#endif
+
+
+#endif
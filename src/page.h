@@ -2,18 +2,43 @@
 #define PMAN_PAGE_H_INCLUDED
 
 
+#include <stdlib.h>
+#include <stdint.h>
 #include "page_manager_conf.h"
 #include "page_manager_timer.h"
+#include "arena.h"
 #ifndef PMAN_EXCLUDE_LVGL
 #include "lvgl.h"
+
+// LVGL object flag marking the objects tagged with `pman_register_obj_id_and_number`
+#ifndef PMAN_OBJ_TAG_FLAG
+#define PMAN_OBJ_TAG_FLAG LV_OBJ_FLAG_USER_4
+#endif
 #endif
 
 
 #define PMAN_MSG_NULL        ((pman_msg_t){.user_msg = NULL, .stack_msg = {.tag = PMAN_STACK_MSG_TAG_NOTHING}})
-#define PMAN_USER_EVENT(ptr) ((pman_event_t){.tag = PMAN_EVENT_TAG_USER, .as = {.user = ptr}})
+#define PMAN_USER_EVENT(ptr) ((pman_event_t){.tag = PMAN_EVENT_TAG_USER, .as = {.user = ptr}, PMAN_EVENT_NO_OBJ})
+
+// Bits for the `event_mask` and `lvgl_event_mask` page fields
+#define PMAN_EVENT_MASK(tag)       (1UL << (tag))
+#define PMAN_LVGL_EVENT_MASK(code) (1ULL << (code))
+
+// `obj_id` of events fired by untagged objects; tagged ids and numbers are 16 bit signed values
+#define PMAN_OBJ_ID_NONE INT32_MIN
+// Last designated initializer of events that don't come from an object
+#ifndef PMAN_EXCLUDE_LVGL
+#define PMAN_EVENT_NO_OBJ .obj_id = PMAN_OBJ_ID_NONE
+#else
+#define PMAN_EVENT_NO_OBJ
+#endif
 
 
 #define PMAN_STACK_MSG_BACK()                  ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_BACK})
+#define PMAN_STACK_MSG_BACK_N(num)                                                                                     \
+    ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_BACK_N, .as = {.count = num}})
+#define PMAN_STACK_MSG_BACK_TO_DEPTH(target)                                                                           \
+    ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_BACK_TO_DEPTH, .as = {.count = target}})
 #define PMAN_STACK_MSG_PUSH_PAGE(page_to_push) PMAN_STACK_MSG_PUSH_PAGE_EXTRA(page_to_push, NULL)
 #define PMAN_STACK_MSG_PUSH_PAGE_EXTRA(page_to_push, extra_ptr)                                                        \
     ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_PUSH_PAGE,                                                           \
@@ -25,6 +50,26 @@
 #define PMAN_STACK_MSG_REBASE(page_to_push)                                                                            \
     ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_REBASE, .as = {.destination = {.page = page_to_push}}})
 
+// Same as above, referencing pages in the registry by id
+#define PMAN_STACK_MSG_PUSH_PAGE_ID(id) PMAN_STACK_MSG_PUSH_PAGE_ID_EXTRA(id, NULL)
+#define PMAN_STACK_MSG_PUSH_PAGE_ID_EXTRA(id, extra_ptr)                                                               \
+    ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_PUSH_PAGE,                                                           \
+                        .as  = {.destination = {.page = NULL, .page_id = id, .extra = extra_ptr}}})
+#define PMAN_STACK_MSG_SWAP_PAGE_ID(id) PMAN_STACK_MSG_SWAP_PAGE_ID_EXTRA(id, NULL)
+#define PMAN_STACK_MSG_SWAP_PAGE_ID_EXTRA(id, extra_ptr)                                                               \
+    ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_SWAP,                                                                \
+                        .as  = {.destination = {.page = NULL, .page_id = id, .extra = extra_ptr}}})
+#define PMAN_STACK_MSG_REBASE_PAGE_ID(id)                                                                              \
+    ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_REBASE, .as = {.destination = {.page = NULL, .page_id = id}}})
+
+// Hints that a page is likely to be pushed next, so that it is created in idle time (see `pman_preload`)
+#define PMAN_STACK_MSG_PRELOAD(page_to_preload) PMAN_STACK_MSG_PRELOAD_EXTRA(page_to_preload, NULL)
+#define PMAN_STACK_MSG_PRELOAD_EXTRA(page_to_preload, extra_ptr)                                                       \
+    ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_PRELOAD,                                                             \
+                        .as  = {.destination = {.page = page_to_preload, .extra = extra_ptr}}})
+#define PMAN_STACK_MSG_PRELOAD_PAGE_ID(id)                                                                             \
+    ((pman_stack_msg_t){.tag = PMAN_STACK_MSG_TAG_PRELOAD, .as = {.destination = {.page = NULL, .page_id = id}}})
+
 
 /**
  * @brief Tags for view messages (i.e. commands that act on the page stack)
@@ -34,9 +79,12 @@ typedef enum {
     PMAN_STACK_MSG_TAG_NOTHING = 0,     // Do nothing
     PMAN_STACK_MSG_TAG_BACK,            // Go back to the previous page
     PMAN_STACK_MSG_TAG_REBASE,          // Rebase to a new page
-    PMAN_STACK_MSG_TAG_RESET_TO,        // Reset to a previous page
+    PMAN_STACK_MSG_TAG_RESET_TO,        // Reset to a previous page (ignored if it is not on the stack)
     PMAN_STACK_MSG_TAG_PUSH_PAGE,       // Change to a new page
     PMAN_STACK_MSG_TAG_SWAP,            // Swap with a new page
+    PMAN_STACK_MSG_TAG_BACK_N,          // Go back by a number of pages at once
+    PMAN_STACK_MSG_TAG_BACK_TO_DEPTH,   // Go back to the page at a given depth from the bottom
+    PMAN_STACK_MSG_TAG_PRELOAD,         // Create a page in idle time, ahead of pushing it (ignored without preloading)
 } pman_stack_msg_tag_t;
 
 
@@ -49,10 +97,12 @@ typedef struct {
 
     union {
         struct {
-            const void *page;      // Page to move to
-            void       *extra;     // Extra argument
+            const void *page;        // Page to move to
+            int         page_id;     // Registered page to move to, if `page` is NULL
+            void       *extra;       // Extra argument
         } destination;
-        int id;     // ID to reset to
+        int    id;        // ID to reset to
+        size_t count;     // Number of pages to go back by, or depth to go back to
     } as;
 } pman_stack_msg_t;
 
@@ -75,10 +125,28 @@ typedef void *pman_handle_t;
 
 
 #ifndef PMAN_EXCLUDE_LVGL
-typedef struct {
+typedef struct pman_timer {
     pman_handle_t handle;
     void         *user_data;
-    lv_timer_t   *timer;
+
+    // Instance of the stack entry that created the timer (0 if none)
+    uint32_t owner;
+    uint32_t period;
+    uint32_t last_run;
+    uint32_t expire;
+    uint32_t pass;
+    // Paused by the page
+    uint8_t paused;
+    // Paused because the owner page is closed
+    uint8_t suspended;
+    uint8_t armed;
+
+    // Wheel slot list
+    struct pman_timer *wheel_prev;
+    struct pman_timer *wheel_next;
+    // List of all timers
+    struct pman_timer *prev;
+    struct pman_timer *next;
 } pman_timer_t;
 #endif
 
@@ -94,9 +162,41 @@ typedef enum {
     PMAN_EVENT_TAG_LVGL,
     PMAN_EVENT_TAG_TIMER,
 #endif
+#if PMAN_ASYNC_JOBS
+    PMAN_EVENT_TAG_JOB,
+#endif
+    PMAN_EVENT_TAG_NUM,
 } pman_event_tag_t;
 
 
+#if PMAN_ASYNC_JOBS
+#if PMAN_EVENT_QUEUE_SIZE == 0
+#error "PMAN_ASYNC_JOBS requires PMAN_EVENT_QUEUE_SIZE"
+#endif
+
+/**
+ * @brief Work started by a page with `pman_start_job`, delivered back to it as a PMAN_EVENT_TAG_JOB event
+ *
+ */
+typedef struct pman_job {
+    // Chosen by the page to tell its jobs apart
+    int id;
+    // Runs on the executor; its return value becomes `result`
+    void *(*work)(void *arg);
+    void *arg;
+    void *result;
+    // If present, called on the UI thread with the result of a job whose page was destroyed before receiving it
+    void (*discard)(void *result, void *arg);
+
+    pman_handle_t handle;
+    // Instance of the stack entry that started the job
+    uint32_t owner;
+    // List of completed jobs waiting for their page to be back on top of the stack
+    struct pman_job *next;
+} pman_job_t;
+#endif
+
+
 /**
  * @brief Page event
  *
@@ -107,30 +207,128 @@ typedef struct {
 #ifndef PMAN_EXCLUDE_LVGL
         lv_event_t   *lvgl;
         pman_timer_t *timer;
+#endif
+#if PMAN_ASYNC_JOBS
+        pman_job_t *job;
 #endif
         void *user;
     } as;
+#ifndef PMAN_EXCLUDE_LVGL
+    // For LVGL events fired by an object tagged with `pman_register_obj_id_and_number`, its id and number; otherwise
+    // `obj_id` is PMAN_OBJ_ID_NONE
+    int obj_id;
+    int obj_number;
+#endif
 } pman_event_t;
 
 
+/**
+ * @brief Page descriptor: the callbacks implementing a page, usually kept in static (possibly const) storage
+ *
+ */
 typedef struct {
-    int   id;
-    void *state;
-    void *extra;
+    int id;
 
     // Called when the page is first created; it initializes and returns the state structures used by the page
     void *(*create)(pman_handle_t handle, void *extra);
     // Called when the page definitively exits the scenes; should free all used memory
     void (*destroy)(void *state, void *extra);
 
-    // Called when the page enters view
+    // Called when the page enters view; widgets go on `pman_get_screen(handle)`, which under PMAN_SCREEN_RETENTION may
+    // not be `lv_scr_act()` yet
     void (*open)(pman_handle_t handle, void *state);
     // Called when the page exits view
     void (*close)(pman_handle_t handle, void *state);
+    // If present, called repeatedly after `open` to build the page incrementally, in slices of at most
+    // PMAN_BUILD_SLICE_TIME milliseconds spread across frames, so that rendering and input go on in the meantime (e.g.
+    // `open` shows a placeholder and each step adds a few widgets). Returns 0 when there is nothing left to build.
+    // Steps stop when the page is closed and start over when it is opened again; they must not change page. Like `open`
+    // they add widgets to `pman_get_screen(handle)`
+    uint8_t (*build_step)(pman_handle_t handle, void *state);
 
     // Called to process an event
     pman_msg_t (*process_event)(pman_handle_t handle, void *state, pman_event_t event);
+    // Event tags passed to `process_event` (PMAN_EVENT_MASK bits); if 0 all events are passed
+    uint32_t event_mask;
+#ifndef PMAN_EXCLUDE_LVGL
+    // LVGL event codes passed to `process_event` (PMAN_LVGL_EVENT_MASK bits); if 0 all codes are passed. Codes above 63
+    // are never filtered
+    uint64_t lvgl_event_mask;
+#endif
+
+    // If present, the state is parked in the state cache instead of being destroyed. When the page is created again
+    // the cached state is passed here instead of calling `create`; returning 0 discards (destroys) it and `create`
+    // runs as usual. The cached extra is replaced by the new one, so pages that free `extra` should not be cached
+    uint8_t (*revalidate)(pman_handle_t handle, void *state, void *extra);
+    // Approximate size in bytes of the state, accounted against the state cache budget
+    size_t state_size;
+
+    // If present, returns the coalescing key of a user event posted with `pman_post_event`; queued events with the same
+    // non negative key are merged before being dispatched
+    int (*coalesce_key)(void *state, void *user);
+    // Merges two posted user events with the same key and returns the payload to dispatch; if NULL the newest wins
+    void *(*coalesce)(void *state, void *older, void *newer);
+
+    // If present, writes the state for `pman_snapshot` in at most `size` bytes of `buffer` (NULL if `size` is 0) and
+    // returns the number of bytes it needs; nothing should be written if they are more than `size`
+    size_t (*serialize)(void *state, uint8_t *buffer, size_t size);
+    // Creates the state from the bytes written by `serialize` when the page is restored by `pman_restore`, in place of
+    // `create`
+    void *(*deserialize)(pman_handle_t handle, void *extra, const uint8_t *data, size_t size);
 } pman_page_t;
 
 
+/**
+ * @brief Page on the stack, made of its descriptor and its runtime state (managed by the page manager)
+ *
+ */
+typedef struct {
+#if PMAN_PAGE_REGISTRY
+    // Descriptors are referenced, so they must outlive the entry
+    const pman_page_t *page;
+#else
+    pman_page_t page;
+#endif
+    void *state;
+    void *extra;
+    // Unique identifier of the stack entry
+    uint32_t instance;
+    // Position of the previous entry with the same id, maintained by the page stack
+    size_t id_link;
+    // The entry was pushed without being created; it is created when it first becomes the top of the stack
+    uint8_t lazy;
+    // Build steps are left to run since the page was opened
+    uint8_t build_pending;
+#if PMAN_PAGE_REGISTRY
+    // `page` is a heap copy of an unregistered page, freed with the entry
+    uint8_t owns_page;
+#endif
+    // State to restore when the lazy entry is created, copied from a snapshot
+    uint8_t *restore_data;
+    size_t   restore_size;
+    // Memory released when the page is destroyed (`view_arena`: when it is closed, or its screen deleted with
+    // PMAN_SCREEN_RETENTION)
+    pman_arena_t arena;
+    pman_arena_t view_arena;
+#if PMAN_STATS_MAX_PAGES > 0
+    // Counters of the page id, looked up when first needed
+    struct pman_page_stats *stats;
+#endif
+
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+    // Screen owned by the page while it is on the stack
+    lv_obj_t *screen;
+    // Whether the screen was kept alive since the last time the page was open
+    uint8_t screen_retained;
+#endif
+} pman_stack_entry_t;
+
+
+#if PMAN_PAGE_REGISTRY
+#define PMAN_ENTRY_PAGE(entry) ((entry)->page)
+#else
+#define PMAN_ENTRY_PAGE(entry) (&(entry)->page)
+#endif
+
+
 #endif
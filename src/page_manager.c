@@ -1,34 +1,178 @@
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include "page_manager_timer.h"
 #include "page_manager.h"
 #include "page.h"
 #include "stack.h"
+#include "trace.h"
 
 
-#define DEFINE_TIMER_WRAPPER(fun)                                                                                      \
-    void pman_timer_##fun(pman_timer_t *timer) { lv_timer_##fun(timer->timer); }
-#define DEFINE_TIMER_WRAPPER_ARG(fun, type)                                                                            \
-    void pman_timer_##fun(pman_timer_t *timer, type arg) { lv_timer_##fun(timer->timer, arg); }
-
+// Snapshot layout (little endian): "PM", version, a reserved byte and the 16 bit page count; then, for each page from
+// the bottom of the stack, its 32 bit id, the 32 bit size of its serialized state and the state itself
+#define SNAPSHOT_VERSION     1
+#define SNAPSHOT_HEADER_SIZE 6
+#define SNAPSHOT_PAGE_SIZE   8
+#define SNAPSHOT_MAX_PAGES   0xFFFF
 
 
 static void clear_page_stack(pman_t *pman);
 static void wait_release(pman_t *pman);
 static void reset_page(pman_t *pman);
 static void page_subscription_cb(pman_t *pman, pman_event_t event);
-static void open_page(pman_handle_t handle, pman_page_t *page);
-static void close_page(pman_t *pman, pman_page_t *page);
-static void destroy_page(pman_page_t *page);
+static void process_stack_msg(pman_t *pman, pman_stack_msg_t msg);
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+static void enqueue_stack_msg(pman_t *pman, pman_stack_msg_t msg);
+static int  dequeue_stack_msg(pman_t *pman, pman_stack_msg_t *msg);
+static void drain_stack_msgs(pman_t *pman);
+static void coalesce_stack_msg(pman_t *pman, pman_stack_msg_t *msg);
+#endif
+static void                open_page(pman_handle_t handle, pman_stack_entry_t *page);
+static void                close_page(pman_t *pman, pman_stack_entry_t *page);
+static void                change_page(pman_t *pman, const pman_page_t *newpage, void *extra);
+static void                swap_page(pman_t *pman, const pman_page_t *newpage, void *extra);
+static void                rebase_page(pman_t *pman, const pman_page_t *newpage, void *extra);
+static void                push_page_lazy(pman_t *pman, const pman_page_t *newpage, void *extra);
+static pman_stack_entry_t *push_page(pman_t *pman, const pman_page_t *page);
+static int                 init_entry(pman_t *pman, pman_stack_entry_t *entry, const pman_page_t *page);
+static void                release_descriptor(pman_stack_entry_t *entry);
+static pman_stack_entry_t *current_entry(pman_t *pman);
+static uint8_t             run_build_slice(pman_t *pman);
+static void                create_page(pman_t *pman, pman_stack_entry_t *page);
+static void                destroy_page(pman_t *pman, pman_stack_entry_t *page);
+static void                release_page(pman_t *pman, pman_stack_entry_t *page);
+static const pman_page_t  *destination_page(pman_t *pman, pman_stack_msg_t *msg);
+static uint8_t             page_accepts_event(const pman_page_t *page, pman_event_t event);
+#if PMAN_STATS_MAX_PAGES > 0
+static pman_page_stats_t *entry_stats(pman_t *pman, pman_stack_entry_t *entry);
+#endif
+#if PMAN_PRELOAD_SLOTS > 0
+static void     preload_page(pman_t *pman, const pman_page_t *page, void *extra);
+static int      take_preload(pman_t *pman, pman_stack_entry_t *page);
+static void     remove_preload(pman_t *pman, size_t index, pman_stack_entry_t *pentry);
+static void     discard_preload(pman_t *pman, size_t index);
+static uint8_t  run_preloads(pman_t *pman);
+static void     enforce_preload_budget(pman_t *pman);
+static uint32_t preload_now(pman_t *pman);
+#endif
+static void *heap_alloc(size_t size);
+static void  heap_free(void *ptr);
+#if PMAN_ASYNC_JOBS
+static size_t  deliver_jobs(pman_t *pman);
+static uint8_t settle_job(pman_t *pman, pman_job_t *job);
+static void    discard_job(pman_t *pman, pman_job_t *job);
+static uint8_t entry_exists(pman_t *pman, uint32_t instance);
+#endif
+static void     write_u32(uint8_t *buffer, uint32_t value);
+static uint32_t read_u32(const uint8_t *buffer);
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+static void    delete_page_screen(pman_stack_entry_t *page);
+static void    enforce_screen_budget(pman_t *pman);
+static void    begin_animation(pman_t *pman, pman_animation_kind_t kind);
+static uint8_t defer_destroy(pman_t *pman, pman_stack_entry_t *page);
+static void    deferred_destroy_callback(lv_timer_t *timer);
+static void    flush_deferred_destroys(pman_t *pman);
+
+// The page animating out of view is destroyed this long after the animation should have ended, so that LVGL is
+// done with its screen
+#define ANIMATION_DESTROY_MARGIN 50
+
+/**
+ * @brief Page destroyed once its screen animated out of view
+ *
+ */
+typedef struct pman_deferred_destroy {
+    pman_t                       *pman;
+    pman_stack_entry_t            page;
+    lv_timer_t                   *timer;
+    struct pman_deferred_destroy *next;
+} deferred_destroy_t;
+
+#define BEGIN_ANIMATION(pman, kind) begin_animation(pman, kind)
+// Every navigation ends with this, so that an animation that wasn't played cannot leak into the next one
+#define END_ANIMATION(pman) ((pman)->next_animation = NULL)
+#else
+#define BEGIN_ANIMATION(pman, kind)
+#define END_ANIMATION(pman)
+#endif
 #ifndef PMAN_EXCLUDE_LVGL
-static void free_user_data_callback(lv_event_t *event);
-static void event_callback(lv_event_t *event);
-static void timer_callback(lv_timer_t *timer);
+static void    free_user_data_callback(lv_event_t *event);
+static void    event_callback(lv_event_t *event);
+static void    delegate_event_callback(lv_event_t *event);
+static uint8_t bubble_tagged_children(lv_obj_t *parent);
+static void    dispatch_obj_event(pman_handle_t handle, lv_event_t *event, lv_obj_t *obj);
+static void    timer_fire_callback(pman_timer_t *timer);
+static void    poll_timer_callback(lv_timer_t *timer);
+static void    build_timer_callback(lv_timer_t *timer);
+#if PMAN_PRELOAD_SLOTS > 0
+static void preload_timer_callback(lv_timer_t *timer);
+static void schedule_preloads(pman_t *pman);
+#endif
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+static void transition_timer_callback(lv_timer_t *timer);
+#endif
+#if PMAN_ASYNC_JOBS
+static void job_timer_callback(lv_timer_t *timer);
+static void schedule_jobs(pman_t *pman);
+#endif
+static pman_display_t *enter_display(pman_t *pman);
 
 #if LVGL_VERSION_MAJOR >= 9
-#define lv_mem_free  lv_free
-#define lv_mem_alloc lv_malloc
+#define lv_mem_free    lv_free
+#define lv_mem_alloc   lv_malloc
+#define lv_mem_realloc lv_realloc
+
+#define display_get_default       lv_display_get_default
+#define display_set_default       lv_display_set_default
+#define display_get_screen_active lv_display_get_screen_active
+#define obj_get_display           lv_obj_get_display
+#else
+#define display_get_default       lv_disp_get_default
+#define display_set_default       lv_disp_set_default
+#define display_get_screen_active lv_disp_get_scr_act
+#define obj_get_display           lv_obj_get_disp
+#endif
+
+// Page callbacks run with the display of the page manager as the default one, so that `lv_scr_act()` and new screens
+// refer to it
+#define ENTER_DISPLAY(pman) pman_display_t *previous_display = enter_display(pman)
+#define LEAVE_DISPLAY()     display_set_default(previous_display)
+
+static void *pool_alloc(pman_pool_t *pool, size_t size);
+static void  pool_free(pman_pool_t *pool, void *ptr);
+
+#if PMAN_TIMER_POOL_SIZE > 0
+PMAN_POOL_BUFFER(timer_pool_buffer, sizeof(pman_timer_t), PMAN_TIMER_POOL_SIZE);
+static pman_pool_t timer_pool = PMAN_POOL_INIT(timer_pool_buffer, sizeof(pman_timer_t), PMAN_TIMER_POOL_SIZE);
+#define TIMER_POOL (&timer_pool)
+#else
+#define TIMER_POOL NULL
+#endif
+
+#if PMAN_USER_DATA_POOL_SIZE > 0
+PMAN_POOL_BUFFER(user_data_pool_buffer, PMAN_USER_DATA_BLOCK_SIZE, PMAN_USER_DATA_POOL_SIZE);
+static pman_pool_t user_data_pool =
+    PMAN_POOL_INIT(user_data_pool_buffer, PMAN_USER_DATA_BLOCK_SIZE, PMAN_USER_DATA_POOL_SIZE);
+#define USER_DATA_POOL (&user_data_pool)
+#else
+#define USER_DATA_POOL NULL
+#endif
+
+#if PMAN_STATE_POOL_SIZE > 0
+PMAN_POOL_BUFFER(state_pool_buffer, PMAN_STATE_BLOCK_SIZE, PMAN_STATE_POOL_SIZE);
+static pman_pool_t state_pool = PMAN_POOL_INIT(state_pool_buffer, PMAN_STATE_BLOCK_SIZE, PMAN_STATE_POOL_SIZE);
+#define STATE_POOL (&state_pool)
+#else
+#define STATE_POOL NULL
 #endif
 
+#else
+#define ENTER_DISPLAY(pman)
+#define LEAVE_DISPLAY()
+
+// Heap used without LVGL, replaced with `pman_set_heap_allocator`
+static void *(*heap_alloc_fn)(size_t size) = malloc;
+static void (*heap_free_fn)(void *ptr)     = free;
 #endif
 
 
@@ -37,7 +181,7 @@ static void timer_callback(lv_timer_t *timer);
  *
  * @param pman Pointer to the page manager instance
  * @param user_data user pointer
- * @param indev optional input device reference
+ * @param indev optional input device reference (more can be added with `pman_add_input_device`)
  * @param user_msg_cb function to handle user messages
  * @param close_global_cb if not NULL, called every time a page is closed
  */
@@ -48,14 +192,194 @@ void pman_init(pman_t *pman, void *user_data,
                pman_user_msg_cb_t user_msg_cb, void (*close_global_cb)(void *handle),
                uint8_t (*event_global_cb)(void *handle, pman_event_t event)) {
 #ifndef PMAN_EXCLUDE_LVGL
-    pman->touch_indev = indev;
+    pman->display     = NULL;
+    pman->indev_count = 0;
+    pman->poll_timer  = NULL;
+    pman->build_timer = NULL;
+#if PMAN_SCREEN_RETENTION > 0
+    for (size_t i = 0; i < PMAN_ANIMATION_NUM; i++) {
+        pman->animations[i] = (pman_animation_t){.anim = LV_SCR_LOAD_ANIM_NONE, .time = 0};
+    }
+    pman->next_animation    = NULL;
+    pman->deferred_destroys = NULL;
+#endif
+    if (indev != NULL) {
+        pman_add_input_device(pman, indev);
+    }
+    pman_timer_wheel_init(&pman->timer_wheel, timer_fire_callback);
 #endif
+    pman->last_instance   = 0;
+    pman->building        = NULL;
+    pman->registry        = NULL;
+    pman->registry_size   = 0;
     pman->user_data       = user_data;
     pman->user_msg_cb     = user_msg_cb;
     pman->close_global_cb = close_global_cb;
     pman->event_global_cb = event_global_cb;
 
     pman_page_stack_init(&pman->page_stack);
+#if !defined(PMAN_EXCLUDE_LVGL) && !defined(PMAN_PAGE_STACK_DEPTH)
+    pman_page_stack_set_allocator(&pman->page_stack, lv_mem_realloc, lv_mem_free);
+#endif
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+    pman->transition_head  = 0;
+    pman->transition_count = 0;
+#ifndef PMAN_EXCLUDE_LVGL
+    pman->transition_timer = NULL;
+#endif
+#endif
+#if PMAN_STATE_CACHE_SIZE > 0
+    pman_state_cache_init(&pman->state_cache);
+#endif
+#if PMAN_PRELOAD_SLOTS > 0
+    pman->preload_count = 0;
+#ifndef PMAN_EXCLUDE_LVGL
+    pman->preload_timer = NULL;
+    pman->preload_clock = lv_tick_get;
+#else
+    pman->preload_clock = NULL;
+#endif
+#endif
+#if PMAN_EVENT_QUEUE_SIZE > 0
+    pman_event_queue_init(&pman->event_queue);
+    pman->rekeyed_count = 0;
+#endif
+#if PMAN_ASYNC_JOBS
+    pman->executor       = NULL;
+    pman->executor_arg   = NULL;
+    pman->jobs_in_flight = 0;
+    pman->parked_jobs    = NULL;
+    pman_event_queue_init(&pman->job_queue);
+#ifndef PMAN_EXCLUDE_LVGL
+    pman->job_timer = NULL;
+#endif
+#endif
+#if PMAN_STATS_MAX_PAGES > 0
+#ifndef PMAN_EXCLUDE_LVGL
+    pman_stats_init(&pman->stats, lv_tick_get);
+#else
+    pman_stats_init(&pman->stats, NULL);
+#endif
+#endif
+#if PMAN_TRACE_SIZE > 0
+    pman_trace_init(&pman->trace);
+#endif
+}
+
+
+/**
+ * @brief Releases everything held by the page manager: the top page is closed, the pages on the stack and the ones
+ * waiting for an animation destroyed, the states in the state cache and the preloaded pages released (their screens
+ * deleted with them), the completed jobs discarded and the timers of the pages and of the page manager deleted.
+ * Jobs must not be running on the executor anymore. The structure can be initialized again afterwards.
+ *
+ * @param pman
+ */
+void pman_deinit(pman_t *pman) {
+    pman_stack_entry_t page;
+
+    END_ANIMATION(pman);
+
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    if (current != NULL) {
+        close_page(pman, current);
+    }
+    while (pman_page_stack_pop(&pman->page_stack, &page) == 0) {
+        destroy_page(pman, &page);
+    }
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+    flush_deferred_destroys(pman);
+#endif
+
+#if PMAN_STATE_CACHE_SIZE > 0
+    while (pman_state_cache_evict(&pman->state_cache, &page) == 0) {
+        release_page(pman, &page);
+    }
+#endif
+
+#if PMAN_PRELOAD_SLOTS > 0
+    while (pman->preload_count > 0) {
+        discard_preload(pman, 0);
+    }
+#endif
+
+#if PMAN_ASYNC_JOBS
+    // No page is left, so every completed job is discarded
+    deliver_jobs(pman);
+    assert(pman->jobs_in_flight == 0);
+#endif
+
+#ifndef PMAN_PAGE_STACK_DEPTH
+    pman_page_stack_deinit(&pman->page_stack);
+#endif
+
+#ifndef PMAN_EXCLUDE_LVGL
+    // Timers created without a page on the stack
+    while (pman->timer_wheel.timers != NULL) {
+        pman_timer_delete(pman->timer_wheel.timers);
+    }
+    pman_timer_wheel_deinit(&pman->timer_wheel);
+
+    lv_timer_t **timers[] = {
+        &pman->poll_timer,
+        &pman->build_timer,
+#if PMAN_PRELOAD_SLOTS > 0
+        &pman->preload_timer,
+#endif
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+        &pman->transition_timer,
+#endif
+#if PMAN_ASYNC_JOBS
+        &pman->job_timer,
+#endif
+    };
+    for (size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); i++) {
+        if (*timers[i] != NULL) {
+            lv_timer_del(*timers[i]);
+            *timers[i] = NULL;
+        }
+    }
+#endif
+
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+    pman->transition_count = 0;
+#endif
+#if PMAN_EVENT_QUEUE_SIZE > 0
+    pman->rekeyed_count = 0;
+#endif
+}
+
+
+/**
+ * @brief Sets the table of page descriptors, indexed by id, that pages can be referenced with (e.g. by
+ * `pman_change_page_id` and `PMAN_STACK_MSG_PUSH_PAGE_ID`). It is never copied, so it can be placed in read only
+ * memory.
+ * With PMAN_PAGE_REGISTRY stack entries reference the registered pages; pages that are not registered can still be
+ * pushed, at the cost of a copy on the heap.
+ *
+ * @param pman
+ * @param pages pages[i].id must be i
+ * @param count
+ */
+void pman_set_registry(pman_t *pman, const pman_page_t *pages, size_t count) {
+    pman->registry      = pages;
+    pman->registry_size = count;
+}
+
+
+/**
+ * @brief Returns the registered page with the given id
+ *
+ * @param pman
+ * @param id
+ * @return const pman_page_t* NULL if there is no such page
+ */
+const pman_page_t *pman_get_registered_page(pman_t *pman, int id) {
+    if (id < 0 || (size_t)id >= pman->registry_size || pman->registry[id].id != id) {
+        return NULL;
+    } else {
+        return &pman->registry[id];
+    }
 }
 
 
@@ -74,27 +398,39 @@ void pman_init(pman_t *pman, void *user_data,
  * @param extra
  */
 void pman_swap_page_extra(pman_t *pman, pman_page_t newpage, void *extra) {
-    pman_page_t *current = pman_page_stack_top(&pman->page_stack);
+    swap_page(pman, &newpage, extra);
+}
+
+
+/**
+ * @brief Swaps the current page with a page passed by reference, so that registered pages are never copied
+ *
+ * @param pman
+ * @param newpage
+ * @param extra
+ */
+static void swap_page(pman_t *pman, const pman_page_t *newpage, void *extra) {
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    pman_stack_entry_t  page;
     assert(current != NULL);
 
+    BEGIN_ANIMATION(pman, PMAN_ANIMATION_SWAP);
     close_page(pman, current);
-    destroy_page(current);
 
-    pman_page_stack_pop(&pman->page_stack, NULL);
+    // The entry leaves the stack first, destroying it may free its descriptor
+    pman_page_stack_pop(&pman->page_stack, &page);
+    destroy_page(pman, &page);
 
-    current = pman_page_stack_push(&pman->page_stack, &newpage);
+    current = push_page(pman, newpage);
     assert(current != NULL);
 
     current->extra = extra;
     // Create the newpage
-    if (current->create) {
-        current->state = current->create(pman, current->extra);
-    } else {
-        current->state = NULL;
-    }
+    create_page(pman, current);
 
     open_page(pman, current);
     reset_page(pman);
+    END_ANIMATION(pman);
 }
 
 
@@ -111,55 +447,222 @@ void pman_swap_page(pman_t *pman, pman_page_t newpage) {
 }
 
 
+/**
+ * @brief Swap the current page with the registered page with the given id
+ *
+ * @param pman
+ * @param id
+ * @param extra
+ * @return int 0 on success, -1 if the page is not registered (nothing changes)
+ */
+int pman_swap_page_id(pman_t *pman, int id, void *extra) {
+    const pman_page_t *page = pman_get_registered_page(pman, id);
+    if (page == NULL) {
+        return -1;
+    }
+
+    swap_page(pman, page, extra);
+    return 0;
+}
+
+
 int pman_get_current_page_id(pman_t *pman) {
-    pman_page_t *current = pman_page_stack_top(&pman->page_stack);
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
     assert(current != NULL);
-    return current->id;
+    return PMAN_ENTRY_PAGE(current)->id;
 }
 
 
 /**
  * @brief Reset the page stack to the highest instance of page with the corresponding id. All pages until the target are
- * closed and destroyed. If no such page is found, clears the whole stack.
+ * closed and destroyed. If no such page is found the stack is left untouched.
  *
  * @param pman
  * @param id
  * @param found whether the target page was found or not
  */
 void pman_reset_to_page_id(pman_t *pman, int id, uint8_t *found) {
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    assert(current != NULL);
+
+    int depth = pman_page_stack_find(&pman->page_stack, id);
     if (found) {
-        *found = 0;
+        *found = depth >= 0;
+    }
+    if (depth < 0) {
+        END_ANIMATION(pman);
+        return;
     }
 
-    pman_page_t *current = pman_page_stack_top(&pman->page_stack);
-    assert(current != NULL);
-
+    BEGIN_ANIMATION(pman, PMAN_ANIMATION_BACK);
     close_page(pman, current);
 
-    do {
-        if (current->id == id) {
-            if (found) {
-                *found = 1;
-            }
+    while (pman_page_stack_size(&pman->page_stack) > (size_t)depth + 1) {
+        pman_stack_entry_t page;
+        pman_page_stack_pop(&pman->page_stack, &page);
+        destroy_page(pman, &page);
+    }
 
-            open_page(pman, current);
-            reset_page(pman);
-            break;
-        } else {
-            destroy_page(current);
+    open_page(pman, pman_page_stack_top(&pman->page_stack));
+    reset_page(pman);
+    END_ANIMATION(pman);
+}
+
+
+/**
+ * @brief Looks up the highest instance of page with the corresponding id without touching the stack; a reset to it
+ * would find its target if the result is not negative
+ *
+ * @param pman
+ * @param id
+ * @return int the depth of the page counting from the bottom of the stack, -1 if it is not on the stack
+ */
+int pman_find_page_id(pman_t *pman, int id) {
+    return pman_page_stack_find(&pman->page_stack, id);
+}
+
+
+/**
+ * @brief Returns the deepest the page stack has been since initialization or the last reset, e.g. to size
+ * PMAN_PAGE_STACK_DEPTH from a recorded session
+ *
+ * @param pman
+ * @param reset if not 0 the peak restarts from the current depth
+ * @return size_t
+ */
+size_t pman_get_peak_depth(pman_t *pman, uint8_t reset) {
+    return pman_page_stack_peak(&pman->page_stack, reset);
+}
+
+
+#ifdef PMAN_EXCLUDE_LVGL
+/**
+ * @brief Sets the heap used for page manager allocations (arenas, job records, restored data) without LVGL, e.g. to
+ * count them. It must be set before any allocation is made.
+ *
+ * @param alloc_fn if NULL `malloc` is used
+ * @param free_fn if NULL `free` is used
+ */
+void pman_set_heap_allocator(void *(*alloc_fn)(size_t size), void (*free_fn)(void *ptr)) {
+    heap_alloc_fn = alloc_fn != NULL ? alloc_fn : malloc;
+    heap_free_fn  = free_fn != NULL ? free_fn : free;
+}
+#endif
+
+
+#if PMAN_STATS_MAX_PAGES > 0
+/**
+ * @brief Copies the counters of the page ids seen so far (at most PMAN_STATS_MAX_PAGES), in order of first
+ * appearance. The resident time of the open page includes the time elapsed until now.
+ *
+ * @param pman
+ * @param stats
+ * @param num size of `stats`
+ * @return size_t number of pages copied
+ */
+size_t pman_get_stats(pman_t *pman, pman_page_stats_t *stats, size_t num) {
+    uint32_t now   = pman_stats_now(&pman->stats);
+    size_t   count = pman->stats.num < num ? pman->stats.num : num;
+
+    for (size_t i = 0; i < count; i++) {
+        stats[i] = pman->stats.items[i];
+        if (stats[i].is_open) {
+            stats[i].resident_time += now - stats[i].open_since;
         }
+    }
+
+    return count;
+}
+
+
+void pman_reset_stats(pman_t *pman) {
+    pman_stats_reset(&pman->stats);
+}
+
+
+/**
+ * @brief Sets the clock used to measure times; by default the LVGL tick (milliseconds), or none without LVGL
+ *
+ * @param pman
+ * @param clock returns the current time in any unit, e.g. microseconds for finer measurements
+ */
+void pman_set_stats_clock(pman_t *pman, uint32_t (*clock)(void)) {
+    pman->stats.clock = clock;
+    pman_stats_reset(&pman->stats);
+}
+#endif
+
+
+#if PMAN_TRACE_SIZE > 0
+/**
+ * @brief Sets the clock used to timestamp trace records; by default the LVGL tick (with millisecond resolution), or
+ * none without LVGL
+ *
+ * @param pman
+ * @param clock_us returns the current time in microseconds
+ */
+void pman_set_trace_clock(pman_t *pman, uint64_t (*clock_us)(void)) {
+    pman_trace_set_clock(&pman->trace, clock_us);
+}
+
+
+void pman_set_trace_enabled(pman_t *pman, uint8_t value) {
+    pman_trace_set_enabled(&pman->trace, value);
+}
+
+
+void pman_clear_trace(pman_t *pman) {
+    pman_trace_clear(&pman->trace);
+}
+
+
+/**
+ * @brief Copies the most recent trace records, oldest first. Can be called from any thread; records overwritten while
+ * they are copied are skipped, which shows as a gap in their sequence numbers.
+ *
+ * @param pman
+ * @param records
+ * @param num size of `records`
+ * @return size_t number of records copied
+ */
+size_t pman_read_trace(pman_t *pman, pman_trace_record_t *records, size_t num) {
+    return pman_trace_read(&pman->trace, records, num);
+}
+
+
+/**
+ * @brief Writes the trace in the Chrome trace event format (JSON), which can be loaded by chrome://tracing or Perfetto.
+ * Can be called from any thread, like `pman_read_trace`.
+ *
+ * @param pman
+ * @param write called with consecutive chunks of the output
+ * @param arg passed to `write`
+ */
+void pman_dump_trace_json(pman_t *pman, void (*write)(const char *data, size_t len, void *arg), void *arg) {
+    pman_trace_dump_json(&pman->trace, write, arg);
+}
+
 
-        pman_page_stack_pop(&pman->page_stack, NULL);
-    } while ((current = pman_page_stack_top(&pman->page_stack)) != NULL);
+/**
+ * @brief Writes the trace in a compact binary format (see trace.c). Can be called from any thread, like
+ * `pman_read_trace`.
+ *
+ * @param pman
+ * @param write called with consecutive chunks of the output
+ * @param arg passed to `write`
+ */
+void pman_dump_trace_binary(pman_t *pman, void (*write)(const char *data, size_t len, void *arg), void *arg) {
+    pman_trace_dump_binary(&pman->trace, write, arg);
 }
+#endif
 
 
 uint8_t pman_is_current_page_id(pman_t *pman, int id) {
-    pman_page_t *current = pman_page_stack_top(&pman->page_stack);
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
     if (current == NULL) {
         return 0;
     } else {
-        return current->id == id;
+        return PMAN_ENTRY_PAGE(current)->id == id;
     }
 }
 
@@ -173,26 +676,36 @@ uint8_t pman_is_current_page_id(pman_t *pman, int id) {
  * @param extra
  */
 void pman_rebase_page_extra(pman_t *pman, pman_page_t newpage, void *extra) {
-    pman_page_t *current = pman_page_stack_top(&pman->page_stack);
+    rebase_page(pman, &newpage, extra);
+}
+
+
+/**
+ * @brief Clears the whole stack and adds a page passed by reference, so that registered pages are never copied
+ *
+ * @param pman
+ * @param newpage
+ * @param extra
+ */
+static void rebase_page(pman_t *pman, const pman_page_t *newpage, void *extra) {
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
     assert(current != NULL);
 
+    BEGIN_ANIMATION(pman, PMAN_ANIMATION_REBASE);
     close_page(pman, current);
     clear_page_stack(pman);
 
-    current = pman_page_stack_push(&pman->page_stack, &newpage);
+    current = push_page(pman, newpage);
     assert(current != NULL);
 
     current->extra = extra;
     // Create the newpage
-    if (current->create) {
-        current->state = current->create(pman, current->extra);
-    } else {
-        current->state = NULL;
-    }
+    create_page(pman, current);
 
     // Open the page
     open_page(pman, current);
     reset_page(pman);
+    END_ANIMATION(pman);
 }
 
 
@@ -208,6 +721,25 @@ void pman_rebase_page(pman_t *pman, pman_page_t newpage) {
 }
 
 
+/**
+ * @brief Clears the whole stack and adds the registered page with the given id
+ *
+ * @param pman
+ * @param id
+ * @param extra
+ * @return int 0 on success, -1 if the page is not registered (nothing changes)
+ */
+int pman_rebase_page_id(pman_t *pman, int id, void *extra) {
+    const pman_page_t *page = pman_get_registered_page(pman, id);
+    if (page == NULL) {
+        return -1;
+    }
+
+    rebase_page(pman, page, extra);
+    return 0;
+}
+
+
 /**
  * @brief Changes the current page passing also the extra argument, adding it on top of the stack. The previous page
  * is closed.
@@ -217,26 +749,38 @@ void pman_rebase_page(pman_t *pman, pman_page_t newpage) {
  * @param extra
  */
 void pman_change_page_extra(pman_t *pman, pman_page_t newpage, void *extra) {
-    pman_page_t *current = pman_page_stack_top(&pman->page_stack);
+    change_page(pman, &newpage, extra);
+}
+
+
+/**
+ * @brief Pushes a page passed by reference on top of the stack, so that registered pages are never copied
+ *
+ * @param pman
+ * @param newpage
+ * @param extra
+ */
+static void change_page(pman_t *pman, const pman_page_t *newpage, void *extra) {
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    BEGIN_ANIMATION(pman, PMAN_ANIMATION_PUSH);
     if (current != NULL) {
         close_page(pman, current);
     }
 
-    current = pman_page_stack_push(&pman->page_stack, &newpage);
+    current = push_page(pman, newpage);
     assert(current != NULL);
 
     current->extra = extra;
-
     // Create the newpage
-    if (current->create) {
-        current->state = current->create(pman, extra);
-    } else {
-        current->state = NULL;
-    }
+    create_page(pman, current);
 
     // Open the page
     open_page(pman, current);
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+    enforce_screen_budget(pman);
+#endif
     reset_page(pman);
+    END_ANIMATION(pman);
 }
 
 
@@ -252,20 +796,410 @@ void pman_change_page(pman_t *pman, pman_page_t page) {
 }
 
 
-void pman_back(pman_t *pman) {
-    pman_page_t page;
+/**
+ * @brief Changes the current page to the registered page with the given id, adding it on top of the stack
+ *
+ * @param pman
+ * @param id
+ * @param extra
+ * @return int 0 on success, -1 if the page is not registered (nothing changes)
+ */
+int pman_change_page_id(pman_t *pman, int id, void *extra) {
+    const pman_page_t *page = pman_get_registered_page(pman, id);
+    if (page == NULL) {
+        return -1;
+    }
 
-    if (pman_page_stack_pop(&pman->page_stack, &page) == 0) {
-        close_page(pman, &page);
-        destroy_page(&page);
+    change_page(pman, page, extra);
+    return 0;
+}
 
-        pman_page_t *current = pman_page_stack_top(&pman->page_stack);
-        assert(current != NULL);
 
-        open_page(pman, current);
-        reset_page(pman);
+/**
+ * @brief Pushes a page on the stack without creating nor opening it; it is created the first time it becomes the top of
+ * the stack again (e.g. through `pman_back` or `pman_reset_to_page_id`). The previous page is closed. Meant to prepare
+ * the history under the page that is actually shown, so a regular page should be pushed on top of it.
+ * If the entry is discarded before being created its `destroy` callback is not called, so the extra argument stays
+ * owned by the caller.
+ *
+ * @param pman
+ * @param newpage
+ * @param extra
+ */
+void pman_push_page_lazy(pman_t *pman, pman_page_t newpage, void *extra) {
+    push_page_lazy(pman, &newpage, extra);
+}
+
+
+/**
+ * @brief Pushes a page passed by reference without creating it, so that registered pages are never copied
+ *
+ * @param pman
+ * @param newpage
+ * @param extra
+ */
+static void push_page_lazy(pman_t *pman, const pman_page_t *newpage, void *extra) {
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    if (current != NULL) {
+        close_page(pman, current);
+    }
+
+    current = push_page(pman, newpage);
+    assert(current != NULL);
+
+    current->extra = extra;
+    current->lazy  = 1;
+    END_ANIMATION(pman);
+}
+
+
+void pman_back(pman_t *pman) {
+    pman_stack_entry_t page;
+
+    if (pman_page_stack_pop(&pman->page_stack, &page) == 0) {
+        BEGIN_ANIMATION(pman, PMAN_ANIMATION_BACK);
+        close_page(pman, &page);
+        destroy_page(pman, &page);
+
+        pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+        assert(current != NULL);
+
+        open_page(pman, current);
+        reset_page(pman);
+    }
+    END_ANIMATION(pman);
+}
+
+
+/**
+ * @brief Goes back by `n` pages at once: the current page is closed, all the pages above the target are destroyed
+ * and only the target is opened. The bottom page is never removed.
+ *
+ * @param pman
+ * @param n
+ */
+void pman_back_n(pman_t *pman, size_t n) {
+    size_t size = pman_page_stack_size(&pman->page_stack);
+    if (n < size) {
+        pman_back_to_depth(pman, size - 1 - n);
+    } else if (size > 0) {
+        pman_back_to_depth(pman, 0);
+    }
+}
+
+
+/**
+ * @brief Goes back to the page at the given depth (counting from the bottom of the stack, which is 0). The current
+ * page is closed, all the pages above the target are destroyed and only the target is opened.
+ *
+ * @param pman
+ * @param depth
+ */
+void pman_back_to_depth(pman_t *pman, size_t depth) {
+    if (depth + 1 >= pman_page_stack_size(&pman->page_stack)) {
+        END_ANIMATION(pman);
+        return;
+    }
+
+    BEGIN_ANIMATION(pman, PMAN_ANIMATION_BACK);
+    close_page(pman, pman_page_stack_top(&pman->page_stack));
+
+    while (pman_page_stack_size(&pman->page_stack) > depth + 1) {
+        pman_stack_entry_t page;
+        pman_page_stack_pop(&pman->page_stack, &page);
+        destroy_page(pman, &page);
+    }
+
+    open_page(pman, pman_page_stack_top(&pman->page_stack));
+    reset_page(pman);
+    END_ANIMATION(pman);
+}
+
+
+/**
+ * @brief Writes the page stack in a compact binary snapshot that `pman_restore` can rebuild: the page ids, from the
+ * bottom of the stack, along with the state of the pages that provide a `serialize` callback. Extra arguments are not
+ * saved. Like `snprintf`, the returned size may exceed the buffer, in which case the snapshot is incomplete.
+ *
+ * @param pman
+ * @param buffer may be NULL to measure the snapshot
+ * @param size size of the buffer
+ * @return size_t the size of the whole snapshot, 0 if the stack holds more pages than the snapshot can count
+ */
+size_t pman_snapshot(pman_t *pman, uint8_t *buffer, size_t size) {
+    size_t count  = pman_page_stack_size(&pman->page_stack);
+    size_t length = SNAPSHOT_HEADER_SIZE;
+
+    if (count > SNAPSHOT_MAX_PAGES) {
+        return 0;
+    }
+
+    if (length <= size) {
+        buffer[0] = 'P';
+        buffer[1] = 'M';
+        buffer[2] = SNAPSHOT_VERSION;
+        buffer[3] = 0;
+        buffer[4] = (uint8_t)(count & 0xFF);
+        buffer[5] = (uint8_t)(count >> 8);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        pman_stack_entry_t *page      = pman_page_stack_at(&pman->page_stack, i);
+        size_t              offset    = length + SNAPSHOT_PAGE_SIZE;
+        size_t              available = offset <= size ? size - offset : 0;
+        size_t              data_size = 0;
+
+        if (page->lazy) {
+            // Not created since the last restore: its data is still there
+            data_size = page->restore_size;
+            if (data_size > 0 && data_size <= available) {
+                memcpy(&buffer[offset], page->restore_data, data_size);
+            }
+        } else if (PMAN_ENTRY_PAGE(page)->serialize != NULL) {
+            PMAN_TRACE(pman, SERIALIZE, BEGIN, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+            data_size =
+                PMAN_ENTRY_PAGE(page)->serialize(page->state, available > 0 ? &buffer[offset] : NULL, available);
+            PMAN_TRACE(pman, SERIALIZE, END, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+        }
+
+        if (offset <= size) {
+            write_u32(&buffer[length], (uint32_t)PMAN_ENTRY_PAGE(page)->id);
+            write_u32(&buffer[length + 4], (uint32_t)data_size);
+        }
+        length = offset + data_size;
+    }
+
+    return length;
+}
+
+
+/**
+ * @brief Replaces the page stack with the one saved in a snapshot. Every page but the top one is pushed lazily, so
+ * only the page that is shown is actually created (through `deserialize` if it saved its state, `create` otherwise)
+ * and opened. Restored pages have no extra argument. The snapshot is validated before touching the stack.
+ *
+ * @param pman
+ * @param data
+ * @param size
+ * @param find_page returns the page descriptor for an id, NULL if unknown; if NULL the registry is used
+ * @return int 0 on success, -1 if the snapshot is invalid, refers to unknown pages or doesn't fit in the stack
+ */
+int pman_restore(pman_t *pman, const uint8_t *data, size_t size, const pman_page_t *(*find_page)(int id)) {
+    // Restored pages are never animated in
+    END_ANIMATION(pman);
+
+    if (size < SNAPSHOT_HEADER_SIZE || data[0] != 'P' || data[1] != 'M' || data[2] != SNAPSHOT_VERSION) {
+        return -1;
+    }
+
+    size_t count  = (size_t)data[4] | ((size_t)data[5] << 8);
+    size_t offset = SNAPSHOT_HEADER_SIZE;
+    if (count == 0) {
+        return -1;
+    }
+#if !PMAN_BOUNDED_HISTORY
+    // Lazy pushes past the capacity would fail after the live stack is gone
+#ifdef PMAN_PAGE_STACK_DEPTH
+    if (count > PMAN_PAGE_STACK_DEPTH) {
+        return -1;
+    }
+#elif PMAN_PAGE_STACK_MAX_DEPTH > 0
+    if (count > PMAN_PAGE_STACK_MAX_DEPTH) {
+        return -1;
+    }
+#endif
+#endif
+
+    for (size_t i = 0; i < count; i++) {
+        if (size - offset < SNAPSHOT_PAGE_SIZE) {
+            return -1;
+        }
+        int    id        = (int)read_u32(&data[offset]);
+        size_t data_size = read_u32(&data[offset + 4]);
+        offset += SNAPSHOT_PAGE_SIZE;
+
+        if (size - offset < data_size ||
+            (find_page != NULL ? find_page(id) : pman_get_registered_page(pman, id)) == NULL) {
+            return -1;
+        }
+        offset += data_size;
+    }
+
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    if (current != NULL) {
+        close_page(pman, current);
+        clear_page_stack(pman);
+    }
+
+    offset = SNAPSHOT_HEADER_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        int    id        = (int)read_u32(&data[offset]);
+        size_t data_size = read_u32(&data[offset + 4]);
+        offset += SNAPSHOT_PAGE_SIZE;
+
+        const pman_page_t *page = find_page != NULL ? find_page(id) : pman_get_registered_page(pman, id);
+        push_page_lazy(pman, page, NULL);
+
+        current = pman_page_stack_top(&pman->page_stack);
+        if (data_size > 0 && page->deserialize != NULL && (current->restore_data = heap_alloc(data_size)) != NULL) {
+            memcpy(current->restore_data, &data[offset], data_size);
+            current->restore_size = data_size;
+        }
+        offset += data_size;
+    }
+
+    open_page(pman, current);
+    reset_page(pman);
+    return 0;
+}
+
+
+#if PMAN_STATE_CACHE_SIZE > 0
+/**
+ * @brief Definitively destroys all page states parked in the state cache
+ *
+ * @param pman
+ */
+void pman_state_cache_flush(pman_t *pman) {
+    pman_stack_entry_t page;
+
+    while (pman_state_cache_evict(&pman->state_cache, &page) == 0) {
+        release_page(pman, &page);
+    }
+}
+#endif
+
+
+#if PMAN_PRELOAD_SLOTS > 0
+/**
+ * @brief Requests a page to be created in idle time (by a timer under LVGL, by `pman_poll` otherwise), ahead of being
+ * pushed. A later push of the same page with the same extra then only opens it. `create` runs while another page is
+ * shown, so it should only prepare the state and leave the widgets to `open`.
+ * When all slots are taken the oldest preload is discarded.
+ *
+ * @param pman
+ * @param page
+ * @param extra
+ */
+void pman_preload(pman_t *pman, pman_page_t page, void *extra) {
+    preload_page(pman, &page, extra);
+}
+
+
+/**
+ * @brief Requests the preload of a page passed by reference, so that registered pages are never copied
+ *
+ * @param pman
+ * @param page
+ * @param extra
+ */
+static void preload_page(pman_t *pman, const pman_page_t *page, void *extra) {
+    for (size_t i = 0; i < pman->preload_count; i++) {
+        pman_preload_t *preload = &pman->preloads[i];
+        if (PMAN_ENTRY_PAGE(&preload->page)->id == page->id && preload->page.extra == extra) {
+            // Already requested
+            preload->timestamp = preload_now(pman);
+            return;
+        }
+    }
+
+    if (pman->preload_count == PMAN_PRELOAD_SLOTS) {
+        discard_preload(pman, 0);
+    }
+
+    pman_preload_t *preload = &pman->preloads[pman->preload_count];
+    if (init_entry(pman, &preload->page, page) != 0) {
+        return;
+    }
+    pman->preload_count++;
+    preload->page.extra = extra;
+    preload->timestamp  = preload_now(pman);
+    preload->ready      = 0;
+
+#ifndef PMAN_EXCLUDE_LVGL
+    if (pman->preload_timer == NULL) {
+        pman->preload_timer = lv_timer_create(preload_timer_callback, PMAN_TIMER_RESOLUTION, pman);
+    }
+    schedule_preloads(pman);
+#endif
+}
+
+
+/**
+ * @brief Same as `pman_preload`, with a page from the registry
+ *
+ * @param pman
+ * @param id
+ * @param extra
+ * @return int 0 on success, -1 if the page is not registered
+ */
+int pman_preload_id(pman_t *pman, int id, void *extra) {
+    const pman_page_t *page = pman_get_registered_page(pman, id);
+    if (page == NULL) {
+        return -1;
+    }
+
+    preload_page(pman, page, extra);
+    return 0;
+}
+
+
+/**
+ * @brief Destroys all preloaded pages and drops the pending requests
+ *
+ * @param pman
+ */
+void pman_preload_flush(pman_t *pman) {
+    while (pman->preload_count > 0) {
+        discard_preload(pman, 0);
+    }
+}
+
+
+/**
+ * @brief Sets the clock PMAN_PRELOAD_TTL is measured with; by default the LVGL tick. Without LVGL there is no default
+ * and preloads never expire until a clock is set.
+ *
+ * @param pman
+ * @param clock returns the current time in milliseconds
+ */
+void pman_set_preload_clock(pman_t *pman, uint32_t (*clock)(void)) {
+    uint32_t now = clock != NULL ? clock() : 0;
+
+    // The age of the parked preloads starts over with the new clock
+    for (size_t i = 0; i < pman->preload_count; i++) {
+        pman->preloads[i].timestamp = now;
     }
+    pman->preload_clock = clock;
+}
+#endif
+
+
+#ifndef PMAN_PAGE_STACK_DEPTH
+/**
+ * @brief Sets the functions used to allocate the dynamic page stack (by default the LVGL heap, or the C library heap
+ * without LVGL). Must be called before the first page is pushed.
+ *
+ * @param pman
+ * @param realloc_fn
+ * @param free_fn
+ */
+void pman_set_page_stack_allocator(pman_t *pman, void *(*realloc_fn)(void *ptr, size_t size),
+                                   void (*free_fn)(void *ptr)) {
+    assert(pman_page_stack_is_empty(&pman->page_stack));
+    pman_page_stack_set_allocator(&pman->page_stack, realloc_fn, free_fn);
+}
+
+
+/**
+ * @brief Releases the unused capacity of the dynamic page stack, e.g. after leaving a deep navigation flow
+ *
+ * @param pman
+ */
+void pman_shrink_page_stack(pman_t *pman) {
+    pman_page_stack_shrink_to_fit(&pman->page_stack);
 }
+#endif
 
 
 /*
@@ -275,308 +1209,2102 @@ void pman_back(pman_t *pman) {
 
 /**
  * @brief Processes an event, sending it to the current page and returning a message from the page to the system.
+ * Events filtered out by the page masks are dropped.
  *
  * @param pman
  * @param event
  * @return void*
  */
 void *pman_process_page_event(pman_t *pman, pman_event_t event) {
-    pman_page_t *current = pman_page_stack_top(&pman->page_stack);
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
     assert(current != NULL);
 
-    pman_msg_t msg = current->process_event(pman, current->state, event);
+    if (current->lazy) {
+        // Nothing to deliver the event to until the page is created
+        return NULL;
+    } else if (!page_accepts_event(PMAN_ENTRY_PAGE(current), event)) {
+        return NULL;
+    }
 
-    switch (msg.stack_msg.tag) {
-        case PMAN_STACK_MSG_TAG_PUSH_PAGE:
-            pman_change_page_extra(pman, *((pman_page_t *)msg.stack_msg.as.destination.page),
-                                   msg.stack_msg.as.destination.extra);
-            break;
+#if PMAN_STATS_MAX_PAGES > 0
+    pman_page_stats_t *stats = entry_stats(pman, current);
+    uint32_t           start = pman_stats_now(&pman->stats);
+#endif
 
-        case PMAN_STACK_MSG_TAG_BACK:
-            pman_back(pman);
-            break;
+    ENTER_DISPLAY(pman);
+    PMAN_TRACE(pman, PROCESS_EVENT, BEGIN, PMAN_ENTRY_PAGE(current)->id, (uint8_t)event.tag);
+    pman_msg_t msg = PMAN_ENTRY_PAGE(current)->process_event(pman, current->state, event);
+    PMAN_TRACE(pman, PROCESS_EVENT, END, PMAN_ENTRY_PAGE(current)->id, (uint8_t)event.tag);
+    LEAVE_DISPLAY();
+
+#if PMAN_STATS_MAX_PAGES > 0
+    if (stats != NULL) {
+        pman_stats_add_time(&stats->process_event, start, pman_stats_now(&pman->stats));
+        stats->events[event.tag]++;
+        stats->stack_msgs[msg.stack_msg.tag]++;
+    }
+#endif
 
-        case PMAN_STACK_MSG_TAG_REBASE:
-            pman_rebase_page(pman, *((pman_page_t *)msg.stack_msg.as.destination.page));
-            break;
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+    enqueue_stack_msg(pman, msg.stack_msg);
+#else
+    process_stack_msg(pman, msg.stack_msg);
+#endif
 
-        case PMAN_STACK_MSG_TAG_SWAP:
-            pman_swap_page_extra(pman, *((pman_page_t *)msg.stack_msg.as.destination.page),
-                                 msg.stack_msg.as.destination.extra);
-            break;
+    return msg.user_msg;
+}
 
-        case PMAN_STACK_MSG_TAG_RESET_TO:
-            pman_reset_to_page_id(pman, msg.stack_msg.as.id, NULL);
+
+/**
+ * @brief Runs deferred work: dispatches the events posted from other threads (PMAN_EVENT_QUEUE_SIZE > 0) and applies
+ * all queued stack messages (PMAN_TRANSITION_QUEUE_SIZE > 0), runs a slice of the build steps of the current page and
+ * creates the oldest pending preload (PMAN_PRELOAD_SLOTS > 0). Transitions, build steps and preloads are run
+ * automatically by timers under LVGL, but this can be called explicitly to control when they happen.
+ *
+ * @param pman
+ */
+void pman_poll(pman_t *pman) {
+#if PMAN_EVENT_QUEUE_SIZE > 0
+    pman_drain_events(pman);
+#endif
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+    drain_stack_msgs(pman);
+#endif
+    run_build_slice(pman);
+#if PMAN_PRELOAD_SLOTS > 0
+    run_preloads(pman);
+#endif
+}
+
+
+#if PMAN_EVENT_QUEUE_SIZE > 0
+/**
+ * @brief Posts a user event for the current page. Unlike `pman_event` it can be called from any thread or interrupt;
+ * the event is dispatched the next time `pman_drain_events` (or `pman_poll`) runs on the UI thread. Events posted
+ * while no page is on the stack stay queued until one is pushed.
+ *
+ * @param pman
+ * @param user user event payload
+ * @return int 0 on success, -1 if the queue is full (the overflow is counted in the statistics)
+ */
+int pman_post_event(pman_t *pman, void *user) {
+    return pman_event_queue_push(&pman->event_queue, user);
+}
+
+
+/**
+ * @brief Dispatches the events posted so far to the current page, after delivering the completed jobs
+ * (PMAN_ASYNC_JOBS). Must be called from the UI thread. Events posted while draining are left for the next call, and
+ * so are all of them while the page stack is empty.
+ * If the current page defines `coalesce_key` events are popped in batches of up to PMAN_EVENT_COALESCE_BATCH and the
+ * ones sharing a key are merged into the position of the first one before dispatching. If an event changes the current
+ * page the rest of its batch is keyed again against the new one.
+ *
+ * @param pman
+ * @return size_t number of dispatched events
+ */
+size_t pman_drain_events(pman_t *pman) {
+    size_t count = 0;
+
+#if PMAN_ASYNC_JOBS
+    deliver_jobs(pman);
+#endif
+
+    if (pman_page_stack_top(&pman->page_stack) == NULL) {
+        return 0;
+    }
+
+    while (count < PMAN_EVENT_QUEUE_SIZE) {
+        void  *batch[PMAN_EVENT_COALESCE_BATCH];
+        int    keys[PMAN_EVENT_COALESCE_BATCH];
+        size_t batch_size = 0;
+        size_t popped     = 0;
+        size_t rekeyed    = 0;
+        void  *user       = NULL;
+
+        // A dispatched event may have emptied the stack; what is left waits for the next page
+        pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+        if (current == NULL) {
             break;
+        }
+        const pman_page_t *page     = PMAN_ENTRY_PAGE(current);
+        uint32_t           instance = current->instance;
+
+        // Events left over by the previous batch come first; they are fewer than a batch, so they all fit
+        while (batch_size < PMAN_EVENT_COALESCE_BATCH &&
+               (rekeyed < pman->rekeyed_count || (count + popped < PMAN_EVENT_QUEUE_SIZE &&
+                                                  pman_event_queue_pop(&pman->event_queue, &user) == 0))) {
+            if (rekeyed < pman->rekeyed_count) {
+                user = pman->rekeyed_events[rekeyed++];
+            } else {
+                popped++;
+            }
 
-        case PMAN_STACK_MSG_TAG_NOTHING:
+            int key = -1;
+            if (page->coalesce_key != NULL) {
+                PMAN_TRACE(pman, COALESCE_KEY, BEGIN, page->id, (uint8_t)PMAN_EVENT_TAG_USER);
+                key = page->coalesce_key(current->state, user);
+                PMAN_TRACE(pman, COALESCE_KEY, END, page->id, (uint8_t)PMAN_EVENT_TAG_USER);
+            }
+
+            size_t i = 0;
+            if (key >= 0) {
+                while (i < batch_size && keys[i] != key) {
+                    i++;
+                }
+            } else {
+                i = batch_size;
+            }
+
+            if (i < batch_size) {
+                if (page->coalesce != NULL) {
+                    PMAN_TRACE(pman, COALESCE, BEGIN, page->id, (uint8_t)PMAN_EVENT_TAG_USER);
+                    batch[i] = page->coalesce(current->state, batch[i], user);
+                    PMAN_TRACE(pman, COALESCE, END, page->id, (uint8_t)PMAN_EVENT_TAG_USER);
+                } else {
+                    batch[i] = user;
+                }
+                pman->event_queue.coalesced++;
+            } else {
+                keys[batch_size]    = key;
+                batch[batch_size++] = user;
+            }
+        }
+        pman->rekeyed_count = 0;
+
+        if (batch_size == 0) {
             break;
+        }
+        count += popped;
+
+        for (size_t i = 0; i < batch_size; i++) {
+            page_subscription_cb(pman, PMAN_USER_EVENT(batch[i]));
+
+            // The keys of the remaining events belong to a page that is gone or covered
+            current = pman_page_stack_top(&pman->page_stack);
+            if (current == NULL || current->instance != instance) {
+                while (++i < batch_size) {
+                    pman->rekeyed_events[pman->rekeyed_count++] = batch[i];
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+
+void pman_get_event_queue_stats(pman_t *pman, pman_event_queue_stats_t *stats) {
+    pman_event_queue_get_stats(&pman->event_queue, stats);
+}
+#endif
+
+
+#if PMAN_ASYNC_JOBS
+/**
+ * @brief Sets the function that hands started jobs to another thread, which must then call `pman_run_job` on them.
+ * Without an executor jobs run inline in `pman_start_job`, and are still delivered later.
+ *
+ * @param pman
+ * @param executor returns 0 if the job was accepted, -1 otherwise
+ * @param arg passed to `executor`
+ */
+void pman_set_executor(pman_t *pman, int (*executor)(pman_job_t *job, void *arg), void *arg) {
+    pman->executor     = executor;
+    pman->executor_arg = arg;
+}
+
+
+/**
+ * @brief Starts a job on behalf of the current page. `work` runs on the executor and its result is delivered to the
+ * very same page instance as a PMAN_EVENT_TAG_JOB event; if the page is covered (or its state is in the state cache)
+ * the event waits until it is back on top, if it was destroyed or its `event_mask` filters job events out the result is
+ * passed to `discard` instead.
+ * Under LVGL a timer delivers the results while jobs are pending. Without LVGL nothing runs on its own: the
+ * application must call `pman_drain_events` (or `pman_poll`) periodically on the UI thread for results to arrive.
+ * The job record is freed after the event: the result belongs to the page.
+ *
+ * @param handle
+ * @param id chosen by the page, found in the `id` field of the event job
+ * @param work
+ * @param arg passed to `work` and `discard`
+ * @param discard may be NULL
+ * @return int 0 on success, -1 if PMAN_EVENT_QUEUE_SIZE jobs are already in flight or the job couldn't be started
+ */
+int pman_start_job(pman_handle_t handle, int id, void *(*work)(void *arg), void *arg,
+                   void (*discard)(void *result, void *arg)) {
+    pman_t             *pman    = handle;
+    pman_stack_entry_t *current = current_entry(pman);
+
+    if (current == NULL || pman->jobs_in_flight >= PMAN_EVENT_QUEUE_SIZE) {
+        return -1;
+    }
+
+    pman_job_t *job = heap_alloc(sizeof(pman_job_t));
+    if (job == NULL) {
+        return -1;
+    }
+    job->id      = id;
+    job->work    = work;
+    job->arg     = arg;
+    job->result  = NULL;
+    job->discard = discard;
+    job->handle  = handle;
+    job->owner   = current->instance;
+    job->next    = NULL;
+
+    pman->jobs_in_flight++;
+    if (pman->executor == NULL) {
+        pman_run_job(job);
+    } else if (pman->executor(job, pman->executor_arg) != 0) {
+        pman->jobs_in_flight--;
+        heap_free(job);
+        return -1;
+    }
+
+#ifndef PMAN_EXCLUDE_LVGL
+    schedule_jobs(pman);
+#endif
+    return 0;
+}
+
+
+/**
+ * @brief Runs a job handed to the executor and posts its completion. Safe to call from any thread.
+ *
+ * @param job
+ */
+void pman_run_job(pman_job_t *job) {
+    pman_t *pman = job->handle;
+
+    job->result = job->work(job->arg);
+    // Never full, there is a cell for every job in flight
+    pman_event_queue_push(&pman->job_queue, job);
+}
+#endif
+
+
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+/**
+ * @brief Tells whether the current page is being opened on the same screen it left when it was closed, i.e. its
+ * widgets are still alive and don't need to be created again. To be called from the `open` callback
+ *
+ * @param handle
+ * @return uint8_t
+ */
+uint8_t pman_is_screen_retained(pman_handle_t handle) {
+    pman_t             *pman    = handle;
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    assert(current != NULL);
+
+    return current->screen_retained && lv_obj_get_child_cnt(current->screen) > 0;
+}
+#endif
+
+
+#ifndef PMAN_EXCLUDE_LVGL
+/**
+ * @brief Returns the screen the current page should put its widgets on. Under PMAN_SCREEN_RETENTION this is the
+ * screen of the page, which `lv_scr_act()` only returns once it is loaded: while an animation set with
+ * `pman_set_animation` runs (i.e. during `open` and the first build steps) it still returns the screen being left.
+ * The screen of a page exists from `open` to `destroy`, so this returns NULL during `create` and preloads. Without
+ * retention it is the active screen of the page manager display.
+ *
+ * @param handle
+ * @return lv_obj_t*
+ */
+lv_obj_t *pman_get_screen(pman_handle_t handle) {
+    pman_t *pman = handle;
+#if PMAN_SCREEN_RETENTION > 0
+    pman_stack_entry_t *current = current_entry(pman);
+    assert(current != NULL);
+
+    return current->screen;
+#else
+    return display_get_screen_active(pman->display);
+#endif
+}
+#endif
+
+
+#ifndef PMAN_EXCLUDE_LVGL
+/**
+ * @brief Binds the page manager to a display: page callbacks run with it as the default display, so screens created
+ * and cleaned by the pages (e.g. with `lv_scr_act()`) belong to it and never touch the ones of other displays. Should
+ * be called before the first page is opened.
+ *
+ * @param pman
+ * @param display NULL to follow the default display
+ */
+void pman_set_display(pman_t *pman, pman_display_t *display) {
+    pman->display = display;
+}
+
+
+#if PMAN_SCREEN_RETENTION > 0
+/**
+ * @brief Sets the screen animation played by a kind of navigation. Both screens stay alive while it runs: a page
+ * leaving the stack is destroyed only after its screen animated out of view, and `close` should not clean it.
+ *
+ * @param pman
+ * @param kind
+ * @param anim
+ * @param time duration in milliseconds; 0 switches screens instantly
+ */
+void pman_set_animation(pman_t *pman, pman_animation_kind_t kind, lv_scr_load_anim_t anim, uint32_t time) {
+    assert(kind < PMAN_ANIMATION_NUM);
+    pman->animations[kind] = (pman_animation_t){.anim = anim, .time = time};
+}
+#endif
+
+
+/**
+ * @brief Adds an input device that should wait for release when the page changes, e.g. one per input device of the
+ * display
+ *
+ * @param pman
+ * @param indev
+ * @return int 0 on success, -1 if PMAN_MAX_INPUT_DEVICES are already bound
+ */
+int pman_add_input_device(pman_t *pman, lv_indev_t *indev) {
+    if (pman->indev_count == PMAN_MAX_INPUT_DEVICES) {
+        return -1;
+    }
+
+    pman->indevs[pman->indev_count++] = indev;
+    return 0;
+}
+
+
+/**
+ * @brief Calls `pman_poll` periodically with a dedicated LVGL timer, so that each page manager instance can drain its
+ * event queue at its own rate
+ *
+ * @param pman
+ * @param period in milliseconds; 0 stops the timer
+ */
+void pman_set_poll_period(pman_t *pman, uint32_t period) {
+    if (period == 0) {
+        if (pman->poll_timer != NULL) {
+            lv_timer_del(pman->poll_timer);
+            pman->poll_timer = NULL;
+        }
+    } else if (pman->poll_timer == NULL) {
+        pman->poll_timer = lv_timer_create(poll_timer_callback, period, pman);
+    } else {
+        lv_timer_set_period(pman->poll_timer, period);
+    }
+}
+
+
+void pman_unregister_obj_event(lv_obj_t *obj) {
+    lv_obj_remove_event_cb(obj, event_callback);
+}
+
+
+void pman_register_obj_event(pman_handle_t handle, lv_obj_t *obj, lv_event_code_t event) {
+    lv_obj_add_event_cb(obj, event_callback, event, handle);
+}
+
+
+/**
+ * @brief Tags an object with an id and a number (both 16 bit signed values), which are passed along with the events
+ * it fires. They are packed in the object user data, which must not be used otherwise (e.g. with
+ * `pman_set_obj_self_destruct`), and require no allocation.
+ *
+ * @param handle
+ * @param obj
+ * @param id
+ * @param number
+ */
+void pman_register_obj_id_and_number(pman_handle_t handle, lv_obj_t *obj, int id, int number) {
+    (void)handle;
+    assert(id >= INT16_MIN && id <= INT16_MAX && number >= INT16_MIN && number <= INT16_MAX);
+    // The user data is either free or holding a previous tag
+    assert(lv_obj_get_user_data(obj) == NULL || lv_obj_has_flag(obj, PMAN_OBJ_TAG_FLAG));
+
+    uintptr_t tag = ((uintptr_t)(uint16_t)id << 16) | (uint16_t)number;
+    lv_obj_set_user_data(obj, (void *)tag);
+    lv_obj_add_flag(obj, PMAN_OBJ_TAG_FLAG);
+}
+
+
+/**
+ * @brief Registers a single callback on a container for the events fired by the tagged objects inside it, instead of
+ * one callback per object. The tagged objects already in the container, and the objects between them and the
+ * container, are made to bubble their events (LV_OBJ_FLAG_EVENT_BUBBLE) up to it; objects added later must bubble
+ * their events themselves. The container does not bubble them any further, unless it is set to.
+ *
+ * @param handle
+ * @param container
+ * @param event
+ */
+void pman_register_obj_delegate(pman_handle_t handle, lv_obj_t *container, lv_event_code_t event) {
+    bubble_tagged_children(container);
+    lv_obj_add_event_cb(container, delegate_event_callback, event, handle);
+}
+
+
+/**
+ * @brief Returns the id an object was tagged with
+ *
+ * @param obj
+ * @return int PMAN_OBJ_ID_NONE if the object is not tagged
+ */
+int pman_get_obj_id(lv_obj_t *obj) {
+    if (!lv_obj_has_flag(obj, PMAN_OBJ_TAG_FLAG)) {
+        return PMAN_OBJ_ID_NONE;
+    }
+    return (int16_t)(((uintptr_t)lv_obj_get_user_data(obj) >> 16) & 0xFFFF);
+}
+
+
+/**
+ * @brief Returns the number an object was tagged with
+ *
+ * @param obj
+ * @return int 0 if the object is not tagged
+ */
+int pman_get_obj_number(lv_obj_t *obj) {
+    if (!lv_obj_has_flag(obj, PMAN_OBJ_TAG_FLAG)) {
+        return 0;
+    }
+    return (int16_t)((uintptr_t)lv_obj_get_user_data(obj) & 0xFFFF);
+}
+
+
+void pman_set_obj_self_destruct(lv_obj_t *obj) {
+    // The user data of tagged objects is not a pointer
+    assert(!lv_obj_has_flag(obj, PMAN_OBJ_TAG_FLAG));
+    lv_obj_remove_event_cb(obj, free_user_data_callback);
+    lv_obj_add_event_cb(obj, free_user_data_callback, LV_EVENT_DELETE, NULL);
+}
+
+
+/**
+ * @brief Allocates a block to be used as object user data, from the user data pool if it fits. It must be freed
+ * through `pman_set_obj_self_destruct`.
+ *
+ * @param size
+ * @return void*
+ */
+void *pman_alloc_obj_user_data(size_t size) {
+    return pool_alloc(USER_DATA_POOL, size);
+}
+
+
+/**
+ * @brief Allocates a page state, from the state pool if it fits. It must be freed with `pman_destroy_all`.
+ *
+ * @param size
+ * @return void*
+ */
+void *pman_alloc_state(size_t size) {
+    return pool_alloc(STATE_POOL, size);
+}
+
+
+/**
+ * @brief Reads usage statistics of a static pool. Disabled pools report zero capacity.
+ *
+ * @param pool
+ * @param stats
+ */
+void pman_get_pool_stats(pman_pool_id_t pool, pman_pool_stats_t *stats) {
+    pman_pool_t *pools[] = {
+        [PMAN_POOL_TIMERS]    = TIMER_POOL,
+        [PMAN_POOL_USER_DATA] = USER_DATA_POOL,
+        [PMAN_POOL_STATE]     = STATE_POOL,
+    };
+
+    if (pools[pool] != NULL) {
+        pman_pool_get_stats(pools[pool], stats);
+    } else {
+        *stats = (pman_pool_stats_t){0};
+    }
+}
+#endif
+
+
+/**
+ * @brief Get the user pointer registered for the page manager instance
+ *
+ * @param handle
+ * @return void*
+ */
+void *pman_get_user_data(pman_handle_t handle) {
+    pman_t *pman = handle;
+    return pman->user_data;
+}
+
+
+/**
+ * @brief Allocates memory that lives as long as the current page: it is released all at once when the page is
+ * destroyed, without the need to free the single blocks.
+ *
+ * @param handle
+ * @param size
+ * @return void*
+ */
+void *pman_arena_alloc(pman_handle_t handle, size_t size) {
+    pman_t             *pman    = handle;
+    pman_stack_entry_t *current = current_entry(pman);
+    assert(current != NULL);
+
+    return pman_arena_take(&current->arena, size, PMAN_ARENA_CHUNK_SIZE, heap_alloc);
+}
+
+
+/**
+ * @brief Allocates memory that lives until the current page is closed, e.g. buffers used by the widgets created
+ * in the `open` callback. With PMAN_SCREEN_RETENTION it lives as long as the screen of the page instead, so that it
+ * is still there for the retained widgets when the page is opened again.
+ *
+ * @param handle
+ * @param size
+ * @return void*
+ */
+void *pman_view_arena_alloc(pman_handle_t handle, size_t size) {
+    pman_t             *pman    = handle;
+    pman_stack_entry_t *current = current_entry(pman);
+    assert(current != NULL);
+
+    return pman_arena_take(&current->view_arena, size, PMAN_ARENA_CHUNK_SIZE, heap_alloc);
+}
+
+
+/**
+ * @brief Send an event to the current page
+ *
+ * @param pman
+ * @param event
+ */
+void pman_event(pman_t *pman, pman_event_t event) {
+    page_subscription_cb(pman, event);
+}
+
+
+/**
+ * @brief Utility function to be assigned to the "destroy" page callback. It clears all page state (attempting to
+ * free it, either from the LVGL heap or from the state pool)
+ *
+ * @param state
+ * @param extra
+ */
+void pman_destroy_all(void *state, void *extra) {
+    (void)extra;
+#ifndef PMAN_EXCLUDE_LVGL
+    pool_free(STATE_POOL, state);
+#endif
+}
+
+
+/**
+ * @brief Utility function to be assigned to the "close" page callback. It clears all LVGL objects on the active screen
+ * of the default display, which is the page manager display while page callbacks run.
+ * Pages relying on screen retention (PMAN_SCREEN_RETENTION) should not use it: their screen is kept for the next
+ * `open`, and while an animated screen load is still running the active screen belongs to another page. To clear the
+ * screen of the page explicitly, use `lv_obj_clean(pman_get_screen(handle))` in `close`.
+ *
+ * @param state
+ * @param extra
+ */
+void pman_close_all(void *state) {
+    (void)state;
+#ifndef PMAN_EXCLUDE_LVGL
+    lv_obj_clean(lv_scr_act());
+#endif
+}
+
+
+#ifndef PMAN_EXCLUDE_LVGL
+/**
+ * @brief Creates a paused timer owned by the current page: it is suspended while the page is closed and deleted
+ * when the page is destroyed, if the page didn't delete it before.
+ *
+ * @param handle
+ * @param period
+ * @param user_data
+ * @return pman_timer_t*
+ */
+pman_timer_t *pman_timer_create(pman_handle_t handle, uint32_t period, void *user_data) {
+    pman_t       *pman  = handle;
+    pman_timer_t *timer = pool_alloc(TIMER_POOL, sizeof(pman_timer_t));
+    if (timer == NULL) {
+        return NULL;
+    }
+
+    pman_stack_entry_t *current = current_entry(pman);
+
+    timer->handle    = handle;
+    timer->user_data = user_data;
+    timer->owner     = current != NULL ? current->instance : 0;
+    timer->period    = period;
+    timer->last_run  = lv_tick_get();
+    timer->pass      = 0;
+    timer->paused    = 1;
+    timer->suspended = 0;
+    pman_timer_wheel_add(&pman->timer_wheel, timer);
+
+    return timer;
+}
+
+
+void pman_timer_delete(pman_timer_t *timer) {
+    pman_t *pman = timer->handle;
+    pman_timer_wheel_remove(&pman->timer_wheel, timer);
+    pool_free(TIMER_POOL, timer);
+}
+
+
+void *pman_timer_get_user_data(pman_timer_t *timer) {
+    return timer->user_data;
+}
+
+
+/**
+ * @brief Makes the timer fire on the next tick (once it is running)
+ *
+ * @param timer
+ */
+void pman_timer_ready(pman_timer_t *timer) {
+    pman_t *pman    = timer->handle;
+    timer->last_run = lv_tick_get() - timer->period;
+    pman_timer_wheel_update(&pman->timer_wheel, timer);
+}
+
+
+void pman_timer_resume(pman_timer_t *timer) {
+    pman_t *pman  = timer->handle;
+    timer->paused = 0;
+    pman_timer_wheel_update(&pman->timer_wheel, timer);
+}
+
+
+/**
+ * @brief Restarts the period of the timer
+ *
+ * @param timer
+ */
+void pman_timer_reset(pman_timer_t *timer) {
+    pman_t *pman    = timer->handle;
+    timer->last_run = lv_tick_get();
+    pman_timer_wheel_update(&pman->timer_wheel, timer);
+}
+
+
+void pman_timer_pause(pman_timer_t *timer) {
+    pman_t *pman  = timer->handle;
+    timer->paused = 1;
+    pman_timer_wheel_update(&pman->timer_wheel, timer);
+}
+
+
+void pman_timer_set_period(pman_timer_t *timer, uint32_t period) {
+    pman_t *pman  = timer->handle;
+    timer->period = period;
+    pman_timer_wheel_update(&pman->timer_wheel, timer);
+}
+#endif
+
+
+/*
+ * Private functions
+ */
+
+
+/**
+ * @brief Open a page that finds itself on top of the stack
+ *
+ * @param pman
+ */
+static void reset_page(pman_t *pman) {
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    assert(current != NULL);
+
+    pman_event(pman, (pman_event_t){.tag = PMAN_EVENT_TAG_OPEN, PMAN_EVENT_NO_OBJ});
+    wait_release(pman);
+}
+
+
+/**
+ * @brief Clears the whole page stack, assuming all pages have already been closed
+ *
+ * @param pman
+ */
+static void clear_page_stack(pman_t *pman) {
+    pman_stack_entry_t page;
+
+    while (pman_page_stack_pop(&pman->page_stack, &page) == 0) {
+        destroy_page(pman, &page);
+    }
+}
+
+
+/**
+ * @brief Signal the input device to wait for realease before sending new events
+ *
+ * @param pman
+ */
+static void wait_release(pman_t *pman) {
+#ifndef PMAN_EXCLUDE_LVGL
+    for (size_t i = 0; i < pman->indev_count; i++) {
+        lv_indev_wait_release(pman->indevs[i]);
+    }
+#endif
+}
+
+
+#ifndef PMAN_EXCLUDE_LVGL
+/**
+ * @brief Callback that frees the user data associated with an object. To be tied to the LV_EVENT_DELETE event.
+ *
+ * @param event
+ */
+static void free_user_data_callback(lv_event_t *event) {
+    if (lv_event_get_code(event) == LV_EVENT_DELETE) {
+        lv_obj_t *obj  = lv_event_get_current_target(event);
+        void     *data = lv_obj_get_user_data(obj);
+        pool_free(USER_DATA_POOL, data);
+    }
+}
+#endif
+
+
+/**
+ * @brief Applies a stack message to the page stack
+ *
+ * @param pman
+ * @param msg
+ */
+static void process_stack_msg(pman_t *pman, pman_stack_msg_t msg) {
+    const pman_page_t *page = NULL;
+
+    switch (msg.tag) {
+        case PMAN_STACK_MSG_TAG_PUSH_PAGE:
+            if ((page = destination_page(pman, &msg)) != NULL) {
+                change_page(pman, page, msg.as.destination.extra);
+            }
+            break;
+
+        case PMAN_STACK_MSG_TAG_BACK:
+            pman_back(pman);
+            break;
+
+        case PMAN_STACK_MSG_TAG_BACK_N:
+            pman_back_n(pman, msg.as.count);
+            break;
+
+        case PMAN_STACK_MSG_TAG_BACK_TO_DEPTH:
+            pman_back_to_depth(pman, msg.as.count);
+            break;
+
+        case PMAN_STACK_MSG_TAG_REBASE:
+            if ((page = destination_page(pman, &msg)) != NULL) {
+                rebase_page(pman, page, NULL);
+            }
+            break;
+
+        case PMAN_STACK_MSG_TAG_SWAP:
+            if ((page = destination_page(pman, &msg)) != NULL) {
+                swap_page(pman, page, msg.as.destination.extra);
+            }
+            break;
+
+        case PMAN_STACK_MSG_TAG_RESET_TO:
+            pman_reset_to_page_id(pman, msg.as.id, NULL);
+            break;
+
+        case PMAN_STACK_MSG_TAG_PRELOAD:
+#if PMAN_PRELOAD_SLOTS > 0
+            if ((page = destination_page(pman, &msg)) != NULL) {
+                preload_page(pman, page, msg.as.destination.extra);
+            }
+#endif
+            break;
+
+        case PMAN_STACK_MSG_TAG_NOTHING:
+            break;
+    }
+}
+
+
+/**
+ * @brief Finds the page a stack message moves to: either its page pointer or the registered page with its page id. An
+ * unregistered page id is logged with PMAN_LOG_WARN.
+ *
+ * @param pman
+ * @param msg
+ * @return const pman_page_t* NULL if the destination is not a valid page
+ */
+static const pman_page_t *destination_page(pman_t *pman, pman_stack_msg_t *msg) {
+    const pman_page_t *page = msg->as.destination.page;
+
+    if (page == NULL) {
+        page = pman_get_registered_page(pman, msg->as.destination.page_id);
+        if (page == NULL) {
+            PMAN_LOG_WARN("Stack message to unregistered page id %i ignored", msg->as.destination.page_id);
+        }
+    }
+
+    return page;
+}
+
+
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+/**
+ * @brief Queues a stack message to be applied on the next poll, merging it with the previous ones when possible. If
+ * the queue is full it is drained on the spot.
+ *
+ * @param pman
+ * @param msg
+ */
+static void enqueue_stack_msg(pman_t *pman, pman_stack_msg_t msg) {
+    coalesce_stack_msg(pman, &msg);
+    if (msg.tag == PMAN_STACK_MSG_TAG_NOTHING) {
+        return;
+    }
+
+    if (pman->transition_count == PMAN_TRANSITION_QUEUE_SIZE) {
+        drain_stack_msgs(pman);
+    }
+
+    size_t tail                  = (pman->transition_head + pman->transition_count) % PMAN_TRANSITION_QUEUE_SIZE;
+    pman->transition_queue[tail] = msg;
+    pman->transition_count++;
+
+#ifndef PMAN_EXCLUDE_LVGL
+    if (pman->transition_timer == NULL) {
+        pman->transition_timer = lv_timer_create(transition_timer_callback, 0, pman);
+    } else {
+        lv_timer_resume(pman->transition_timer);
+    }
+#endif
+}
+
+
+static int dequeue_stack_msg(pman_t *pman, pman_stack_msg_t *msg) {
+    if (pman->transition_count == 0) {
+        return -1;
+    }
+
+    *msg                  = pman->transition_queue[pman->transition_head];
+    pman->transition_head = (pman->transition_head + 1) % PMAN_TRANSITION_QUEUE_SIZE;
+    pman->transition_count--;
+
+    return 0;
+}
+
+
+/**
+ * @brief Applies all queued stack messages, including the ones queued in the meantime
+ *
+ * @param pman
+ */
+static void drain_stack_msgs(pman_t *pman) {
+    pman_stack_msg_t msg;
+
+    while (dequeue_stack_msg(pman, &msg) == 0) {
+        process_stack_msg(pman, msg);
+    }
+
+#ifndef PMAN_EXCLUDE_LVGL
+    if (pman->transition_timer != NULL) {
+        lv_timer_pause(pman->transition_timer);
+    }
+#endif
+}
+
+
+/**
+ * @brief Merges a new stack message with the tail of the queue. Messages are only dropped when no extra argument
+ * would be lost with them, since the page receiving it may be responsible for freeing it.
+ *
+ * @param pman
+ * @param msg the new message; it is modified in place and set to NOTHING if it was completely absorbed
+ */
+static void coalesce_stack_msg(pman_t *pman, pman_stack_msg_t *msg) {
+    while (pman->transition_count > 0) {
+        size_t            last = (pman->transition_head + pman->transition_count - 1) % PMAN_TRANSITION_QUEUE_SIZE;
+        pman_stack_msg_t *tail = &pman->transition_queue[last];
+
+        if (msg->tag == PMAN_STACK_MSG_TAG_PUSH_PAGE && tail->tag == PMAN_STACK_MSG_TAG_BACK) {
+            // Going back and then forward is a swap
+            tail->tag            = PMAN_STACK_MSG_TAG_SWAP;
+            tail->as.destination = msg->as.destination;
+            msg->tag             = PMAN_STACK_MSG_TAG_NOTHING;
+            return;
+        } else if ((msg->tag == PMAN_STACK_MSG_TAG_BACK || msg->tag == PMAN_STACK_MSG_TAG_BACK_N) &&
+                   (tail->tag == PMAN_STACK_MSG_TAG_BACK || tail->tag == PMAN_STACK_MSG_TAG_BACK_N)) {
+            // Consecutive backs are applied in a single pass, without opening the pages in between
+            tail->as.count = (tail->tag == PMAN_STACK_MSG_TAG_BACK ? 1 : tail->as.count) +
+                             (msg->tag == PMAN_STACK_MSG_TAG_BACK ? 1 : msg->as.count);
+            tail->tag      = PMAN_STACK_MSG_TAG_BACK_N;
+            msg->tag       = PMAN_STACK_MSG_TAG_NOTHING;
+            return;
+        } else if (msg->tag == PMAN_STACK_MSG_TAG_REBASE &&
+                   (tail->tag == PMAN_STACK_MSG_TAG_BACK || tail->tag == PMAN_STACK_MSG_TAG_BACK_N ||
+                    tail->tag == PMAN_STACK_MSG_TAG_BACK_TO_DEPTH || tail->tag == PMAN_STACK_MSG_TAG_RESET_TO ||
+                    ((tail->tag == PMAN_STACK_MSG_TAG_PUSH_PAGE || tail->tag == PMAN_STACK_MSG_TAG_SWAP) &&
+                     tail->as.destination.extra == NULL))) {
+            // Anything before a rebase would be destroyed right away
+            pman->transition_count--;
+        } else {
+            return;
+        }
+    }
+}
+#endif
+
+
+/**
+ * @brief Page subscription to events
+ *
+ * @param pman
+ * @param event
+ */
+static void page_subscription_cb(pman_t *pman, pman_event_t event) {
+    void *user_msg = pman_process_page_event(pman, event);
+
+    ENTER_DISPLAY(pman);
+    uint8_t override = 0;
+    if (pman->event_global_cb != NULL) {
+        PMAN_TRACE(pman, EVENT_GLOBAL_CB, BEGIN, PMAN_TRACE_NO_PAGE, (uint8_t)event.tag);
+        override = pman->event_global_cb(pman, event);
+        PMAN_TRACE(pman, EVENT_GLOBAL_CB, END, PMAN_TRACE_NO_PAGE, (uint8_t)event.tag);
+    }
+
+    if (!override && user_msg != NULL && pman->user_msg_cb) {
+        PMAN_TRACE(pman, USER_MSG_CB, BEGIN, PMAN_TRACE_NO_PAGE, (uint8_t)event.tag);
+        pman->user_msg_cb(pman, user_msg);
+        PMAN_TRACE(pman, USER_MSG_CB, END, PMAN_TRACE_NO_PAGE, (uint8_t)event.tag);
+    }
+    LEAVE_DISPLAY();
+}
+
+
+/**
+ * @brief Checks an event against the masks of a page
+ *
+ * @param page
+ * @param event
+ * @return uint8_t whether `process_event` should be called
+ */
+static uint8_t page_accepts_event(const pman_page_t *page, pman_event_t event) {
+    if (page->event_mask != 0 && (page->event_mask & PMAN_EVENT_MASK(event.tag)) == 0) {
+        return 0;
+    }
+
+#ifndef PMAN_EXCLUDE_LVGL
+    if (event.tag == PMAN_EVENT_TAG_LVGL && page->lvgl_event_mask != 0) {
+        lv_event_code_t code = lv_event_get_code(event.as.lvgl);
+        if (code < 64 && (page->lvgl_event_mask & PMAN_LVGL_EVENT_MASK(code)) == 0) {
+            return 0;
+        }
+    }
+#endif
+
+    return 1;
+}
+
+
+#if PMAN_STATS_MAX_PAGES > 0
+/**
+ * @brief Returns the counters of the page id of an entry, looking them up only the first time
+ *
+ * @param pman
+ * @param entry
+ * @return pman_page_stats_t* NULL if the statistics table is full
+ */
+static pman_page_stats_t *entry_stats(pman_t *pman, pman_stack_entry_t *entry) {
+    if (entry->stats == NULL) {
+        entry->stats = pman_stats_get(&pman->stats, PMAN_ENTRY_PAGE(entry)->id);
+    }
+    return entry->stats;
+}
+#endif
+
+
+#if PMAN_PRELOAD_SLOTS > 0
+/**
+ * @brief Hands the state of a matching preload over to a page being created
+ *
+ * @param pman
+ * @param page
+ * @return int 0 if the page took a preloaded state, -1 if it must be created
+ */
+static int take_preload(pman_t *pman, pman_stack_entry_t *page) {
+    for (size_t i = 0; i < pman->preload_count; i++) {
+        pman_preload_t *preload = &pman->preloads[i];
+
+        if (PMAN_ENTRY_PAGE(&preload->page)->id == PMAN_ENTRY_PAGE(page)->id && preload->page.extra == page->extra) {
+            uint8_t            ready = preload->ready;
+            pman_stack_entry_t preloaded;
+
+            // A pending request is dropped, the page is about to be created anyway
+            remove_preload(pman, i, &preloaded);
+            release_descriptor(&preloaded);
+            if (!ready) {
+                return -1;
+            }
+
+            // The preloaded state keeps the timers it created
+            page->state      = preloaded.state;
+            page->instance   = preloaded.instance;
+            page->arena      = preloaded.arena;
+            page->view_arena = preloaded.view_arena;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ * @brief Removes a preload, destroying its page if it was already created
+ *
+ * @param pman
+ * @param index
+ */
+static void discard_preload(pman_t *pman, size_t index) {
+    uint8_t            ready = pman->preloads[index].ready;
+    pman_stack_entry_t page;
+
+    remove_preload(pman, index, &page);
+    if (ready) {
+        release_page(pman, &page);
+    } else {
+        release_descriptor(&page);
+    }
+}
+
+
+static void remove_preload(pman_t *pman, size_t index, pman_stack_entry_t *pentry) {
+    *pentry = pman->preloads[index].page;
+
+    pman->preload_count--;
+    for (size_t i = index; i < pman->preload_count; i++) {
+        pman->preloads[i] = pman->preloads[i + 1];
+    }
+}
+
+
+/**
+ * @brief Destroys the expired preloads and creates the oldest pending one
+ *
+ * @param pman
+ * @return uint8_t whether preloads are still waiting to be created
+ */
+static uint8_t run_preloads(pman_t *pman) {
+    pman_stack_entry_t page;
+    uint32_t           now = preload_now(pman);
+
+#if PMAN_PRELOAD_TTL > 0
+    for (size_t i = 0; i < pman->preload_count;) {
+        if (pman->preloads[i].ready && now - pman->preloads[i].timestamp >= PMAN_PRELOAD_TTL) {
+            remove_preload(pman, i, &page);
+            release_page(pman, &page);
+        } else {
+            i++;
+        }
+    }
+#endif
+
+    for (size_t i = 0; i < pman->preload_count; i++) {
+        if (!pman->preloads[i].ready) {
+            // Taken out while it is created, so that it cannot match itself
+            remove_preload(pman, i, &page);
+
+            pman->building = &page;
+            create_page(pman, &page);
+            pman->building = NULL;
+#ifndef PMAN_EXCLUDE_LVGL
+            // Timers started by `create` wait for the first `open`, instead of firing on the page on top
+            pman_timer_wheel_suspend_owner(&pman->timer_wheel, page.instance, 1);
+#endif
+
+            pman_preload_t *preload = &pman->preloads[pman->preload_count++];
+            preload->page           = page;
+            preload->timestamp      = now;
+            preload->ready          = 1;
+
+            enforce_preload_budget(pman);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < pman->preload_count; i++) {
+        if (!pman->preloads[i].ready) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Destroys the oldest preloaded pages until their states fit in PMAN_PRELOAD_BUDGET
+ *
+ * @param pman
+ */
+static void enforce_preload_budget(pman_t *pman) {
+#if PMAN_PRELOAD_BUDGET > 0
+    size_t bytes = 0;
+    for (size_t i = 0; i < pman->preload_count; i++) {
+        if (pman->preloads[i].ready) {
+            bytes += PMAN_ENTRY_PAGE(&pman->preloads[i].page)->state_size;
+        }
+    }
+
+    for (size_t i = 0; i < pman->preload_count && bytes > PMAN_PRELOAD_BUDGET;) {
+        if (pman->preloads[i].ready) {
+            pman_stack_entry_t page;
+
+            remove_preload(pman, i, &page);
+            bytes -= PMAN_ENTRY_PAGE(&page)->state_size;
+            release_page(pman, &page);
+        } else {
+            i++;
+        }
+    }
+#else
+    (void)pman;
+#endif
+}
+
+
+static uint32_t preload_now(pman_t *pman) {
+    return pman->preload_clock != NULL ? pman->preload_clock() : 0;
+}
+#endif
+
+
+#ifndef PMAN_EXCLUDE_LVGL
+/**
+ * @brief LVGL events callback
+ *
+ * @param event
+ */
+static void event_callback(lv_event_t *event) {
+    dispatch_obj_event(lv_event_get_user_data(event), event, lv_event_get_current_target(event));
+}
+
+
+/**
+ * @brief Makes the tagged descendants of an object, and the objects between them and it, bubble their events
+ *
+ * @param parent
+ * @return uint8_t whether any tagged descendant was found
+ */
+static uint8_t bubble_tagged_children(lv_obj_t *parent) {
+    uint8_t found = 0;
+
+    for (uint32_t i = 0; i < lv_obj_get_child_cnt(parent); i++) {
+        lv_obj_t *child = lv_obj_get_child(parent, (int32_t)i);
+        if (bubble_tagged_children(child) || lv_obj_has_flag(child, PMAN_OBJ_TAG_FLAG)) {
+            lv_obj_add_flag(child, LV_OBJ_FLAG_EVENT_BUBBLE);
+            found = 1;
+        }
+    }
+
+    return found;
+}
+
+
+/**
+ * @brief LVGL events callback of delegate containers; only events coming from tagged objects are dispatched
+ *
+ * @param event
+ */
+static void delegate_event_callback(lv_event_t *event) {
+    lv_obj_t *container = lv_event_get_current_target(event);
+    lv_obj_t *obj       = lv_event_get_target(event);
+
+    // The event may come from a child of the tagged object
+    while (obj != NULL && obj != container && !lv_obj_has_flag(obj, PMAN_OBJ_TAG_FLAG)) {
+        obj = lv_obj_get_parent(obj);
+    }
+
+    if (obj != NULL && obj != container) {
+        dispatch_obj_event(lv_event_get_user_data(event), event, obj);
+    }
+}
+
+
+/**
+ * @brief Sends an LVGL event to the current page, decoding the tag of the object it refers to
+ *
+ * @param handle
+ * @param event
+ * @param obj
+ */
+static void dispatch_obj_event(pman_handle_t handle, lv_event_t *event, lv_obj_t *obj) {
+    pman_event_t pman_event = {
+        .tag        = PMAN_EVENT_TAG_LVGL,
+        .as         = {.lvgl = event},
+        .obj_id     = pman_get_obj_id(obj),
+        .obj_number = pman_get_obj_number(obj),
+    };
+
+    page_subscription_cb(handle, pman_event);
+}
+
+
+/**
+ * @brief Makes the display of the page manager the default one
+ *
+ * @param pman
+ * @return pman_display_t* the previous default display, to be restored afterwards
+ */
+static pman_display_t *enter_display(pman_t *pman) {
+    pman_display_t *previous = display_get_default();
+    if (pman->display != NULL) {
+        display_set_default(pman->display);
+    }
+    return previous;
+}
+
+
+static void poll_timer_callback(lv_timer_t *timer) {
+    pman_poll(lv_timer_get_user_data(timer));
+}
+
+
+/**
+ * @brief Runs a build slice at every timer handler cycle, so that rendering and input are processed in between
+ *
+ * @param timer
+ */
+static void build_timer_callback(lv_timer_t *timer) {
+    if (!run_build_slice(lv_timer_get_user_data(timer))) {
+        lv_timer_pause(timer);
+    }
+}
+
+
+#if PMAN_ASYNC_JOBS
+static void job_timer_callback(lv_timer_t *timer) {
+    deliver_jobs(lv_timer_get_user_data(timer));
+}
+
+
+/**
+ * @brief Runs the job timer every PMAN_TIMER_RESOLUTION milliseconds while jobs are running or completed jobs wait for
+ * the page on top, and pauses it otherwise
+ *
+ * @param pman
+ */
+static void schedule_jobs(pman_t *pman) {
+    uint8_t             pending = pman->jobs_in_flight > 0;
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+
+    for (pman_job_t *job = pman->parked_jobs; !pending && job != NULL && current != NULL; job = job->next) {
+        pending = job->owner == current->instance;
+    }
+
+    if (pending) {
+        if (pman->job_timer == NULL) {
+            pman->job_timer = lv_timer_create(job_timer_callback, PMAN_TIMER_RESOLUTION, pman);
+        } else {
+            lv_timer_resume(pman->job_timer);
+        }
+    } else if (pman->job_timer != NULL) {
+        lv_timer_pause(pman->job_timer);
+    }
+}
+#endif
+
+
+#if PMAN_PRELOAD_SLOTS > 0
+static void preload_timer_callback(lv_timer_t *timer) {
+    pman_t *pman = lv_timer_get_user_data(timer);
+    run_preloads(pman);
+    schedule_preloads(pman);
+}
+
+
+/**
+ * @brief Sets when the preload timer fires next: every PMAN_TIMER_RESOLUTION milliseconds while preloads wait to be
+ * created, at the first expiration while created ones are parked with PMAN_PRELOAD_TTL, never otherwise
+ *
+ * @param pman
+ */
+static void schedule_preloads(pman_t *pman) {
+    uint32_t period = 0;
+#if PMAN_PRELOAD_TTL > 0
+    uint32_t now = preload_now(pman);
+#endif
+
+    for (size_t i = 0; i < pman->preload_count; i++) {
+        uint32_t delay = PMAN_TIMER_RESOLUTION;
+#if PMAN_PRELOAD_TTL > 0
+        if (pman->preloads[i].ready) {
+            uint32_t age = now - pman->preloads[i].timestamp;
+            delay        = age < PMAN_PRELOAD_TTL ? PMAN_PRELOAD_TTL - age : 1;
+        }
+#else
+        if (pman->preloads[i].ready) {
+            continue;
+        }
+#endif
+        if (period == 0 || delay < period) {
+            period = delay;
+        }
+    }
+
+    if (period == 0) {
+        lv_timer_pause(pman->preload_timer);
+    } else {
+        lv_timer_set_period(pman->preload_timer, period);
+        lv_timer_reset(pman->preload_timer);
+        lv_timer_resume(pman->preload_timer);
+    }
+}
+#endif
+
+
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+/**
+ * @brief Drains the transition queue outside of the LVGL event that generated it
+ *
+ * @param timer
+ */
+static void transition_timer_callback(lv_timer_t *timer) {
+    drain_stack_msgs(lv_timer_get_user_data(timer));
+}
+#endif
+
+
+/**
+ * @brief Timer wheel callback
+ *
+ * @param timer
+ */
+static void timer_fire_callback(pman_timer_t *timer) {
+    pman_event_t pman_event = {
+        .tag    = PMAN_EVENT_TAG_TIMER,
+        .as     = {.timer = timer},
+        .obj_id = PMAN_OBJ_ID_NONE,
+    };
+
+    page_subscription_cb(timer->handle, pman_event);
+}
+#endif
+
+
+/**
+ * @brief Pushes a new entry for the page on the stack. With PMAN_BOUNDED_HISTORY a full stack makes room by destroying
+ * the page at the bottom.
+ *
+ * @param pman
+ * @param page
+ * @return pman_stack_entry_t* the page on the stack, NULL if the stack is full or the entry couldn't be initialized
+ */
+static pman_stack_entry_t *push_page(pman_t *pman, const pman_page_t *page) {
+#if PMAN_BOUNDED_HISTORY
+    pman_stack_entry_t evicted;
+    if (pman_page_stack_is_full(&pman->page_stack) && pman_page_stack_dequeue(&pman->page_stack, &evicted) == 0) {
+        destroy_page(pman, &evicted);
+    }
+#endif
+
+    pman_stack_entry_t entry;
+    if (init_entry(pman, &entry, page) != 0) {
+        return NULL;
+    }
+
+    pman_stack_entry_t *pushed = pman_page_stack_push(&pman->page_stack, &entry);
+    if (pushed == NULL) {
+        release_descriptor(&entry);
+    }
+    return pushed;
+}
+
+
+/**
+ * @brief Initializes a stack entry for a page, with no runtime state. With PMAN_PAGE_REGISTRY the entry references the
+ * registered page with the same id, or a copy of the page on the heap if its id is not registered.
+ *
+ * @param pman
+ * @param entry
+ * @param page
+ * @return int 0 on success, -1 if the copy of an unregistered page couldn't be allocated
+ */
+static int init_entry(pman_t *pman, pman_stack_entry_t *entry, const pman_page_t *page) {
+    *entry = (pman_stack_entry_t){0};
+#if PMAN_PAGE_REGISTRY
+    entry->page = pman_get_registered_page(pman, page->id);
+    if (entry->page == NULL) {
+        pman_page_t *copy = heap_alloc(sizeof(pman_page_t));
+        if (copy == NULL) {
+            return -1;
+        }
+        *copy            = *page;
+        entry->page      = copy;
+        entry->owns_page = 1;
+    }
+#else
+    (void)pman;
+    entry->page = *page;
+#endif
+    return 0;
+}
+
+
+/**
+ * @brief Frees the copy of an unregistered page held by an entry that is going away (PMAN_PAGE_REGISTRY)
+ *
+ * @param entry
+ */
+static void release_descriptor(pman_stack_entry_t *entry) {
+#if PMAN_PAGE_REGISTRY
+    if (entry->owns_page) {
+        heap_free((void *)entry->page);
+        entry->page      = NULL;
+        entry->owns_page = 0;
+    }
+#else
+    (void)entry;
+#endif
+}
+
+
+/**
+ * @brief Returns the entry that functions taking the page handle refer to
+ *
+ * @param pman
+ * @return pman_stack_entry_t* the entry being created outside of the stack, if any, otherwise the top of the stack
+ */
+static pman_stack_entry_t *current_entry(pman_t *pman) {
+    return pman->building != NULL ? pman->building : pman_page_stack_top(&pman->page_stack);
+}
+
+
+/**
+ * @brief Runs the build steps of the current page for up to PMAN_BUILD_SLICE_TIME milliseconds (a single step without
+ * LVGL)
+ *
+ * @param pman
+ * @return uint8_t whether steps are left for the next slice
+ */
+static uint8_t run_build_slice(pman_t *pman) {
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    if (current == NULL || !current->build_pending) {
+        return 0;
     }
 
-    return msg.user_msg;
-}
-
+    const pman_page_t *descriptor = PMAN_ENTRY_PAGE(current);
 
+    ENTER_DISPLAY(pman);
 #ifndef PMAN_EXCLUDE_LVGL
-void pman_unregister_obj_event(lv_obj_t *obj) {
-    lv_obj_remove_event_cb(obj, event_callback);
+    uint32_t deadline = lv_tick_get() + PMAN_BUILD_SLICE_TIME;
+    do {
+        PMAN_TRACE(pman, BUILD_STEP, BEGIN, descriptor->id, PMAN_TRACE_NO_EVENT);
+        current->build_pending = descriptor->build_step(pman, current->state);
+        PMAN_TRACE(pman, BUILD_STEP, END, descriptor->id, PMAN_TRACE_NO_EVENT);
+    } while (current->build_pending && (int32_t)(lv_tick_get() - deadline) < 0);
+#else
+    PMAN_TRACE(pman, BUILD_STEP, BEGIN, descriptor->id, PMAN_TRACE_NO_EVENT);
+    current->build_pending = descriptor->build_step(pman, current->state);
+    PMAN_TRACE(pman, BUILD_STEP, END, descriptor->id, PMAN_TRACE_NO_EVENT);
+#endif
+    LEAVE_DISPLAY();
+
+    return current->build_pending;
 }
 
 
-void pman_register_obj_event(pman_handle_t handle, lv_obj_t *obj, lv_event_code_t event) {
-    lv_obj_add_event_cb(obj, event_callback, event, handle);
-}
+/**
+ * @brief Creates the state of a page, reusing a cached one if the page accepts it
+ *
+ * @param pman
+ * @param page
+ */
+static void create_page(pman_t *pman, pman_stack_entry_t *page) {
+    const pman_page_t *descriptor = PMAN_ENTRY_PAGE(page);
 
+    page->instance = ++pman->last_instance;
+    pman_arena_init(&page->arena);
+    pman_arena_init(&page->view_arena);
 
-void pman_set_obj_self_destruct(lv_obj_t *obj) {
-    lv_obj_remove_event_cb(obj, free_user_data_callback);
-    lv_obj_add_event_cb(obj, free_user_data_callback, LV_EVENT_DELETE, NULL);
-}
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+    page->screen          = NULL;
+    page->screen_retained = 0;
 #endif
 
+    if (page->restore_data != NULL) {
+        ENTER_DISPLAY(pman);
+        PMAN_TRACE(pman, DESERIALIZE, BEGIN, descriptor->id, PMAN_TRACE_NO_EVENT);
+        page->state = descriptor->deserialize(pman, page->extra, page->restore_data, page->restore_size);
+        PMAN_TRACE(pman, DESERIALIZE, END, descriptor->id, PMAN_TRACE_NO_EVENT);
+        LEAVE_DISPLAY();
+        heap_free(page->restore_data);
+        page->restore_data = NULL;
+        page->restore_size = 0;
+        return;
+    }
 
-/**
- * @brief Get the user pointer registered for the page manager instance
- *
- * @param handle
- * @return void*
- */
-void *pman_get_user_data(pman_handle_t handle) {
-    pman_t *pman = handle;
-    return pman->user_data;
+#if PMAN_PRELOAD_SLOTS > 0
+    if (take_preload(pman, page) == 0) {
+        return;
+    }
+#endif
+
+#if PMAN_STATE_CACHE_SIZE > 0
+    pman_stack_entry_t cached;
+
+    if (descriptor->revalidate != NULL && pman_state_cache_take(&pman->state_cache, descriptor->id, &cached) == 0) {
+        ENTER_DISPLAY(pman);
+        PMAN_TRACE(pman, REVALIDATE, BEGIN, descriptor->id, PMAN_TRACE_NO_EVENT);
+        uint8_t valid = descriptor->revalidate(pman, cached.state, page->extra);
+        PMAN_TRACE(pman, REVALIDATE, END, descriptor->id, PMAN_TRACE_NO_EVENT);
+        LEAVE_DISPLAY();
+
+        if (valid) {
+            // The revived state keeps the timers it created
+            page->state      = cached.state;
+            page->instance   = cached.instance;
+            page->arena      = cached.arena;
+            page->view_arena = cached.view_arena;
+            release_descriptor(&cached);
+            return;
+        } else {
+            release_page(pman, &cached);
+        }
+    }
+#endif
+
+    if (descriptor->create) {
+#if PMAN_STATS_MAX_PAGES > 0
+        uint32_t start = pman_stats_now(&pman->stats);
+#endif
+        ENTER_DISPLAY(pman);
+        PMAN_TRACE(pman, CREATE, BEGIN, descriptor->id, PMAN_TRACE_NO_EVENT);
+        page->state = descriptor->create(pman, page->extra);
+        PMAN_TRACE(pman, CREATE, END, descriptor->id, PMAN_TRACE_NO_EVENT);
+        LEAVE_DISPLAY();
+#if PMAN_STATS_MAX_PAGES > 0
+        pman_page_stats_t *stats = entry_stats(pman, page);
+        if (stats != NULL) {
+            pman_stats_add_time(&stats->create, start, pman_stats_now(&pman->stats));
+        }
+#endif
+    } else {
+        page->state = NULL;
+    }
 }
 
 
 /**
- * @brief Send an event to the current page
+ * @brief Destroys a page, parking its state in the state cache if the page supports it
  *
  * @param pman
- * @param event
+ * @param page
  */
-void pman_event(pman_t *pman, pman_event_t event) {
-    page_subscription_cb(pman, event);
+static void destroy_page(pman_t *pman, pman_stack_entry_t *page) {
+    if (page->lazy) {
+        if (page->restore_data != NULL) {
+            heap_free(page->restore_data);
+        }
+        release_descriptor(page);
+        return;
+    }
+
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+    if (defer_destroy(pman, page)) {
+        return;
+    }
+
+    // Widgets never outlive the page on the stack, cached states included
+    delete_page_screen(page);
+#endif
+
+#if PMAN_STATE_CACHE_SIZE > 0
+    if (PMAN_ENTRY_PAGE(page)->revalidate != NULL) {
+#if PMAN_STATE_CACHE_BUDGET > 0
+        if (PMAN_ENTRY_PAGE(page)->state_size > PMAN_STATE_CACHE_BUDGET) {
+            release_page(pman, page);
+            return;
+        }
+#endif
+
+        pman_stack_entry_t evicted;
+        while (pman_state_cache_needs_room(&pman->state_cache, PMAN_ENTRY_PAGE(page)->state_size) &&
+               pman_state_cache_evict(&pman->state_cache, &evicted) == 0) {
+            release_page(pman, &evicted);
+        }
+
+        pman_state_cache_insert(&pman->state_cache, page);
+        return;
+    }
+#else
+    (void)pman;
+#endif
+
+    release_page(pman, page);
 }
 
 
 /**
- * @brief Utility function to be assigned to the "destroy" page callback. It clears all page state (attempting to
- * free it)
+ * @brief Definitively frees the state of a page, along with its arenas and the timers it left behind
  *
- * @param state
- * @param extra
+ * @param pman
+ * @param page
  */
-void pman_destroy_all(void *state, void *extra) {
-    (void)extra;
+static void release_page(pman_t *pman, pman_stack_entry_t *page) {
+    if (PMAN_ENTRY_PAGE(page)->destroy) {
+        ENTER_DISPLAY(pman);
+        PMAN_TRACE(pman, DESTROY, BEGIN, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+        PMAN_ENTRY_PAGE(page)->destroy(page->state, page->extra);
+        PMAN_TRACE(pman, DESTROY, END, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+        LEAVE_DISPLAY();
+    }
+
+    pman_arena_release(&page->arena, heap_free);
+    pman_arena_release(&page->view_arena, heap_free);
+
 #ifndef PMAN_EXCLUDE_LVGL
-    lv_mem_free(state);
+    pman_timer_t *timer = NULL;
+    while ((timer = pman_timer_wheel_take_owner(&pman->timer_wheel, page->instance)) != NULL) {
+        pool_free(TIMER_POOL, timer);
+    }
+#else
+    (void)pman;
 #endif
+
+    release_descriptor(page);
 }
 
 
 /**
- * @brief Utility function to be assigned to the "close" page callback. It clears all LVGL objects on screen.
+ * @brief Opens a page, creating it first if it was pushed lazily
  *
- * @param state
- * @param extra
+ * @param handle
+ * @param page
  */
-void pman_close_all(void *state) {
-    (void)state;
+static void open_page(pman_handle_t handle, pman_stack_entry_t *page) {
+    if (page->lazy) {
+        page->lazy = 0;
+        create_page(handle, page);
+    }
+
+    ENTER_DISPLAY(handle);
+
 #ifndef PMAN_EXCLUDE_LVGL
-    lv_obj_clean(lv_scr_act());
+    pman_t *pman = handle;
 #endif
-}
 
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+    if (page->screen == NULL) {
+        page->screen          = lv_obj_create(NULL);
+        page->screen_retained = 0;
+    } else {
+        page->screen_retained = 1;
+    }
+
+    if (pman->next_animation != NULL) {
+        lv_scr_load_anim(page->screen, pman->next_animation->anim, pman->next_animation->time, 0, false);
+        pman->next_animation = NULL;
+    } else {
+        lv_scr_load(page->screen);
+    }
+#endif
 
 #ifndef PMAN_EXCLUDE_LVGL
-pman_timer_t *pman_timer_create(pman_handle_t handle, uint32_t period, void *user_data) {
-    pman_timer_t *timer = lv_mem_alloc(sizeof(pman_timer_t));
-    if (timer == NULL) {
-        return NULL;
+    pman_timer_wheel_suspend_owner(&pman->timer_wheel, page->instance, 0);
+#endif
+
+#if PMAN_STATS_MAX_PAGES > 0
+    pman_stats_t      *stats      = &((pman_t *)handle)->stats;
+    pman_page_stats_t *page_stats = entry_stats(handle, page);
+    uint32_t           start      = pman_stats_now(stats);
+#endif
+
+    if (PMAN_ENTRY_PAGE(page)->open) {
+        PMAN_TRACE((pman_t *)handle, OPEN, BEGIN, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+        PMAN_ENTRY_PAGE(page)->open(handle, page->state);
+        PMAN_TRACE((pman_t *)handle, OPEN, END, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
     }
 
-    timer->handle    = handle;
-    timer->user_data = user_data;
-    timer->timer     = lv_timer_create(timer_callback, period, timer);
-    lv_timer_set_repeat_count(timer->timer, -1);
-    lv_timer_pause(timer->timer);
+#if PMAN_STATS_MAX_PAGES > 0
+    if (page_stats != NULL) {
+        uint32_t end = pman_stats_now(stats);
+        page_stats->opens++;
+        if (PMAN_ENTRY_PAGE(page)->open) {
+            pman_stats_add_time(&page_stats->open, start, end);
+        }
+        page_stats->open_since = end;
+        page_stats->is_open    = 1;
+    }
+#endif
 
-    return timer;
+    LEAVE_DISPLAY();
+
+    page->build_pending = PMAN_ENTRY_PAGE(page)->build_step != NULL;
+#ifndef PMAN_EXCLUDE_LVGL
+    if (page->build_pending) {
+        if (pman->build_timer == NULL) {
+            pman->build_timer = lv_timer_create(build_timer_callback, 0, pman);
+        } else {
+            lv_timer_resume(pman->build_timer);
+        }
+    }
+#if PMAN_ASYNC_JOBS
+    // Jobs parked while the page was covered can be delivered now
+    schedule_jobs(pman);
+#endif
+#endif
 }
 
 
-void pman_timer_delete(pman_timer_t *timer) {
-    lv_timer_del(timer->timer);
-    lv_mem_free(timer);
-}
+/**
+ * @brief Closes a page
+ *
+ * @param pman
+ * @param page
+ */
+static void close_page(pman_t *pman, pman_stack_entry_t *page) {
+    if (page->lazy) {
+        return;
+    }
 
+    page->build_pending = 0;
 
-void *pman_timer_get_user_data(pman_timer_t *timer) {
-    return timer->user_data;
-}
+    ENTER_DISPLAY(pman);
+    if (pman->close_global_cb != NULL) {
+        PMAN_TRACE(pman, CLOSE_GLOBAL_CB, BEGIN, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+        pman->close_global_cb(pman);
+        PMAN_TRACE(pman, CLOSE_GLOBAL_CB, END, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+    }
+    if (PMAN_ENTRY_PAGE(page)->close) {
+        PMAN_TRACE(pman, CLOSE, BEGIN, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+        PMAN_ENTRY_PAGE(page)->close(pman, page->state);
+        PMAN_TRACE(pman, CLOSE, END, PMAN_ENTRY_PAGE(page)->id, PMAN_TRACE_NO_EVENT);
+    }
+    LEAVE_DISPLAY();
+#if defined(PMAN_EXCLUDE_LVGL) || PMAN_SCREEN_RETENTION == 0
+    pman_arena_reset(&page->view_arena, heap_free);
+#endif
 
+#if PMAN_STATS_MAX_PAGES > 0
+    pman_page_stats_t *stats = entry_stats(pman, page);
+    if (stats != NULL && stats->is_open) {
+        stats->resident_time += pman_stats_now(&pman->stats) - stats->open_since;
+        stats->is_open = 0;
+    }
+#endif
 
-DEFINE_TIMER_WRAPPER(ready)
-DEFINE_TIMER_WRAPPER(resume)
-DEFINE_TIMER_WRAPPER(reset)
-DEFINE_TIMER_WRAPPER(pause)
-DEFINE_TIMER_WRAPPER_ARG(set_period, uint32_t)
+#ifndef PMAN_EXCLUDE_LVGL
+    pman_timer_wheel_suspend_owner(&pman->timer_wheel, page->instance, 1);
 #endif
+}
 
 
-/*
- * Private functions
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+/**
+ * @brief Deletes the screen owned by a page, if any, along with the view arena its widgets may point into
+ *
+ * @param page
  */
+static void delete_page_screen(pman_stack_entry_t *page) {
+    if (page->screen != NULL) {
+        lv_obj_del(page->screen);
+        page->screen = NULL;
+    }
+    pman_arena_reset(&page->view_arena, heap_free);
+}
 
 
 /**
- * @brief Open a page that finds itself on top of the stack
+ * @brief Deletes the screens of the deepest covered pages until at most PMAN_SCREEN_RETENTION are left
  *
  * @param pman
  */
-static void reset_page(pman_t *pman) {
-    pman_page_t *current = pman_page_stack_top(&pman->page_stack);
-    assert(current != NULL);
+static void enforce_screen_budget(pman_t *pman) {
+    size_t size     = pman_page_stack_size(&pman->page_stack);
+    size_t retained = 0;
+
+    // The top page is always on screen and doesn't count against the budget
+    for (size_t i = 0; i + 1 < size; i++) {
+        if (pman_page_stack_at(&pman->page_stack, i)->screen != NULL) {
+            retained++;
+        }
+    }
 
-    pman_event(pman, (pman_event_t){.tag = PMAN_EVENT_TAG_OPEN});
-    wait_release(pman);
+    for (size_t i = 0; i + 1 < size && retained > PMAN_SCREEN_RETENTION; i++) {
+        pman_stack_entry_t *page = pman_page_stack_at(&pman->page_stack, i);
+        if (page->screen != NULL) {
+            delete_page_screen(page);
+            retained--;
+        }
+    }
 }
 
 
 /**
- * @brief Clears the whole page stack, assuming all pages have already been closed
+ * @brief Picks the animation played when the destination of the navigation in progress is opened
  *
  * @param pman
+ * @param kind
  */
-static void clear_page_stack(pman_t *pman) {
-    pman_page_t page;
-
-    while (pman_page_stack_pop(&pman->page_stack, &page) == 0) {
-        destroy_page(&page);
-    }
+static void begin_animation(pman_t *pman, pman_animation_kind_t kind) {
+    const pman_animation_t *animation = &pman->animations[kind];
+    pman->next_animation = animation->anim != LV_SCR_LOAD_ANIM_NONE && animation->time > 0 ? animation : NULL;
 }
 
 
 /**
- * @brief Signal the input device to wait for realease before sending new events
+ * @brief Postpones the destruction of a page whose screen is about to animate out of view until the animation is
+ * over. LVGL v8 has no completion callback for screen loads, so a one-shot timer outlasting the animation is used.
  *
  * @param pman
+ * @param page
+ * @return uint8_t 1 if the page will be destroyed later, 0 if it should be destroyed now
  */
-static void wait_release(pman_t *pman) {
-#ifndef PMAN_EXCLUDE_LVGL
-    if (pman->touch_indev != NULL) {
-        lv_indev_wait_release(pman->touch_indev);
+static uint8_t defer_destroy(pman_t *pman, pman_stack_entry_t *page) {
+    if (pman->next_animation == NULL || page->screen == NULL ||
+        display_get_screen_active(obj_get_display(page->screen)) != page->screen) {
+        return 0;
     }
-#endif
+
+    deferred_destroy_t *deferred = heap_alloc(sizeof(deferred_destroy_t));
+    if (deferred == NULL) {
+        return 0;
+    }
+    deferred->pman = pman;
+    deferred->page = *page;
+
+    lv_timer_t *timer =
+        lv_timer_create(deferred_destroy_callback, pman->next_animation->time + ANIMATION_DESTROY_MARGIN, deferred);
+    if (timer == NULL) {
+        heap_free(deferred);
+        return 0;
+    }
+    lv_timer_set_repeat_count(timer, 1);
+
+    deferred->timer         = timer;
+    deferred->next          = pman->deferred_destroys;
+    pman->deferred_destroys = deferred;
+
+    return 1;
+}
+
+
+static void deferred_destroy_callback(lv_timer_t *timer) {
+    deferred_destroy_t *deferred = lv_timer_get_user_data(timer);
+    pman_t             *pman     = deferred->pman;
+
+    deferred_destroy_t **link = &pman->deferred_destroys;
+    while (*link != deferred) {
+        link = &(*link)->next;
+    }
+    *link = deferred->next;
+
+    // Another animation may be starting right now, but this screen is not part of it
+    const pman_animation_t *next_animation = pman->next_animation;
+    pman->next_animation                   = NULL;
+    destroy_page(pman, &deferred->page);
+    pman->next_animation = next_animation;
+
+    heap_free(deferred);
 }
 
 
-#ifndef PMAN_EXCLUDE_LVGL
 /**
- * @brief Callback that frees the user data associated with an object. To be tied to the LV_EVENT_DELETE event.
+ * @brief Destroys right away the pages waiting for their screen to animate out of view
  *
- * @param event
+ * @param pman
  */
-static void free_user_data_callback(lv_event_t *event) {
-    if (lv_event_get_code(event) == LV_EVENT_DELETE) {
-        lv_obj_t *obj  = lv_event_get_current_target(event);
-        void     *data = lv_obj_get_user_data(obj);
-        lv_mem_free(data);
+static void flush_deferred_destroys(pman_t *pman) {
+    const pman_animation_t *next_animation = pman->next_animation;
+    pman->next_animation                   = NULL;
+
+    while (pman->deferred_destroys != NULL) {
+        deferred_destroy_t *deferred = pman->deferred_destroys;
+        pman->deferred_destroys      = deferred->next;
+
+        lv_timer_del(deferred->timer);
+        destroy_page(pman, &deferred->page);
+        heap_free(deferred);
     }
+
+    pman->next_animation = next_animation;
 }
 #endif
 
 
+#ifndef PMAN_EXCLUDE_LVGL
 /**
- * @brief Page subscription to events
+ * @brief Allocates from a pool, falling back to the LVGL heap
  *
- * @param pman
- * @param event
+ * @param pool may be NULL if the pool is disabled
+ * @param size
+ * @return void*
  */
-static void page_subscription_cb(pman_t *pman, pman_event_t event) {
-    void *user_msg = pman_process_page_event(pman, event);
+static void *pool_alloc(pman_pool_t *pool, size_t size) {
+    void *ptr = pool != NULL ? pman_pool_alloc(pool, size) : NULL;
+    return ptr != NULL ? ptr : lv_mem_alloc(size);
+}
 
-    uint8_t override = 0;
-    if (pman->event_global_cb != NULL) {
-        override = pman->event_global_cb(pman, event);
+
+static void pool_free(pman_pool_t *pool, void *ptr) {
+    if (pool == NULL || pman_pool_free(pool, ptr) != 0) {
+        lv_mem_free(ptr);
     }
+}
+#endif
 
-    if (!override && pman->user_msg_cb) {
-        pman->user_msg_cb(pman, user_msg);
+
+static void write_u32(uint8_t *buffer, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        buffer[i] = (uint8_t)(value >> (i * 8));
     }
 }
 
 
+static uint32_t read_u32(const uint8_t *buffer) {
+    return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+
+static void *heap_alloc(size_t size) {
 #ifndef PMAN_EXCLUDE_LVGL
-/**
- * @brief LVGL events callback
- *
- * @param event
- */
-static void event_callback(lv_event_t *event) {
-    pman_event_t pman_event = {
-        .tag = PMAN_EVENT_TAG_LVGL,
-        .as  = {.lvgl = event},
-    };
+    return lv_mem_alloc(size);
+#else
+    return heap_alloc_fn(size);
+#endif
+}
 
-    pman_handle_t handle = lv_event_get_user_data(event);
-    page_subscription_cb(handle, pman_event);
+
+static void heap_free(void *ptr) {
+#ifndef PMAN_EXCLUDE_LVGL
+    lv_mem_free(ptr);
+#else
+    heap_free_fn(ptr);
+#endif
 }
 
 
+#if PMAN_ASYNC_JOBS
 /**
- * @brief LVGL timers callback
+ * @brief Delivers the completed jobs of the page on top of the stack, parked ones first
  *
- * @param timer
+ * @param pman
+ * @return size_t number of jobs delivered
  */
-static void timer_callback(lv_timer_t *timer) {
-    pman_timer_t *pman_timer = lv_timer_get_user_data(timer);
+static size_t deliver_jobs(pman_t *pman) {
+    size_t      count   = 0;
+    size_t      popped  = 0;
+    pman_job_t *pending = pman->parked_jobs;
+    void       *job     = NULL;
+
+    pman->parked_jobs = NULL;
+
+    for (;;) {
+        if (pending != NULL) {
+            job     = pending;
+            pending = pending->next;
+        } else if (popped < PMAN_EVENT_QUEUE_SIZE && pman_event_queue_pop(&pman->job_queue, &job) == 0) {
+            // Jobs started while delivering are left for the next call
+            popped++;
+            pman->jobs_in_flight--;
+        } else {
+            break;
+        }
 
-    pman_event_t pman_event = {
-        .tag = PMAN_EVENT_TAG_TIMER,
-        .as  = {.timer = pman_timer},
-    };
+        count += settle_job(pman, job);
+    }
 
-    page_subscription_cb(pman_timer->handle, pman_event);
-}
+#ifndef PMAN_EXCLUDE_LVGL
+    schedule_jobs(pman);
 #endif
+    return count;
+}
 
 
 /**
- * @brief Destroys a page
+ * @brief Delivers a completed job to its page if it is on top of the stack, parks it if the page is still alive
+ * (covered, preloaded or in the state cache) and discards it otherwise, or if the page filters job events out.
+ * Stack entries are told apart by instance, so a new page with the same id doesn't count.
  *
- * @param page
+ * @param pman
+ * @param job
+ * @return uint8_t 1 if the job was delivered
  */
-static void destroy_page(pman_page_t *page) {
-    if (page->destroy) {
-        page->destroy(page->state, page->extra);
+static uint8_t settle_job(pman_t *pman, pman_job_t *job) {
+    pman_stack_entry_t *current = pman_page_stack_top(&pman->page_stack);
+    pman_event_t        event   = {.tag = PMAN_EVENT_TAG_JOB, .as = {.job = job}, PMAN_EVENT_NO_OBJ};
+
+    if (current != NULL && current->instance == job->owner && !current->lazy) {
+        if (!page_accepts_event(PMAN_ENTRY_PAGE(current), event)) {
+            discard_job(pman, job);
+            return 0;
+        }
+        page_subscription_cb(pman, event);
+        heap_free(job);
+        return 1;
+    } else if (entry_exists(pman, job->owner)) {
+        pman_job_t **tail = &pman->parked_jobs;
+        while (*tail != NULL) {
+            tail = &(*tail)->next;
+        }
+        job->next = NULL;
+        *tail     = job;
+        return 0;
+    } else {
+        discard_job(pman, job);
+        return 0;
     }
 }
 
 
 /**
- * @brief Opens a page
+ * @brief Frees a job whose result cannot be delivered, passing the result to its `discard` callback first
  *
- * @param handle
- * @param page
+ * @param pman
+ * @param job
  */
-static void open_page(pman_handle_t handle, pman_page_t *page) {
-    if (page->open) {
-        page->open(handle, page->state);
+static void discard_job(pman_t *pman, pman_job_t *job) {
+    if (job->discard != NULL) {
+        ENTER_DISPLAY(pman);
+        PMAN_TRACE(pman, JOB_DISCARD, BEGIN, PMAN_TRACE_NO_PAGE, (uint8_t)PMAN_EVENT_TAG_JOB);
+        job->discard(job->result, job->arg);
+        PMAN_TRACE(pman, JOB_DISCARD, END, PMAN_TRACE_NO_PAGE, (uint8_t)PMAN_EVENT_TAG_JOB);
+        LEAVE_DISPLAY();
     }
+    heap_free(job);
 }
 
 
 /**
- * @brief Closes a page
+ * @brief Tells whether a stack entry is still alive: on the stack, preloaded or with its state in the state cache
  *
  * @param pman
- * @param page
+ * @param instance
+ * @return uint8_t
  */
-static void close_page(pman_t *pman, pman_page_t *page) {
-    if (pman->close_global_cb != NULL) {
-        pman->close_global_cb(pman);
+static uint8_t entry_exists(pman_t *pman, uint32_t instance) {
+    for (size_t i = 0; i < pman_page_stack_size(&pman->page_stack); i++) {
+        if (pman_page_stack_at(&pman->page_stack, i)->instance == instance) {
+            return 1;
+        }
     }
-    if (page->close) {
-        page->close(pman, page->state);
+
+#if PMAN_PRELOAD_SLOTS > 0
+    for (size_t i = 0; i < pman->preload_count; i++) {
+        if (pman->preloads[i].page.instance == instance) {
+            return 1;
+        }
+    }
+#endif
+
+#if PMAN_STATE_CACHE_SIZE > 0
+    if (pman_state_cache_contains(&pman->state_cache, instance)) {
+        return 1;
     }
+#endif
+
+    return 0;
 }
+#endif
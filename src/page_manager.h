@@ -4,6 +4,12 @@
 #include <stdint.h>
 #include "page_manager_conf.h"
 #include "stack.h"
+#include "state_cache.h"
+#include "stats.h"
+#include "trace.h"
+#include "event_queue.h"
+#include "coroutine.h"
+#include "pool.h"
 #ifndef PMAN_EXCLUDE_LVGL
 #include "lvgl.h"
 #endif
@@ -14,6 +20,66 @@
 
 typedef void (*pman_user_msg_cb_t)(pman_handle_t, void *);
 
+#ifndef PMAN_EXCLUDE_LVGL
+#if LVGL_VERSION_MAJOR >= 9
+typedef lv_display_t pman_display_t;
+#else
+typedef lv_disp_t pman_display_t;
+#endif
+#endif
+
+
+/**
+ * @brief Static block pools
+ *
+ */
+typedef enum {
+    PMAN_POOL_TIMERS = 0,
+    PMAN_POOL_USER_DATA,
+    PMAN_POOL_STATE,
+} pman_pool_id_t;
+
+
+#if PMAN_PRELOAD_SLOTS > 0
+/**
+ * @brief Page created ahead of being pushed
+ *
+ */
+typedef struct {
+    pman_stack_entry_t page;
+    // When the preload was requested, or completed
+    uint32_t timestamp;
+    // Whether `create` already ran
+    uint8_t ready;
+} pman_preload_t;
+#endif
+
+
+#if !defined(PMAN_EXCLUDE_LVGL) && PMAN_SCREEN_RETENTION > 0
+/**
+ * @brief Kinds of navigation that can be animated
+ *
+ */
+typedef enum {
+    PMAN_ANIMATION_PUSH = 0,     // `pman_change_page` and PUSH_PAGE messages
+    PMAN_ANIMATION_BACK,         // `pman_back`, `pman_back_n`, `pman_back_to_depth`, `pman_reset_to_page_id`
+    PMAN_ANIMATION_SWAP,         // `pman_swap_page` and SWAP messages
+    PMAN_ANIMATION_REBASE,       // `pman_rebase_page` and REBASE messages
+    PMAN_ANIMATION_NUM,
+} pman_animation_kind_t;
+
+
+/**
+ * @brief Screen load animation
+ *
+ */
+typedef struct {
+    lv_scr_load_anim_t anim;
+    // Duration in milliseconds; 0 disables the animation
+    uint32_t time;
+} pman_animation_t;
+#endif
+
 
 /**
  * @brief Page manager structure
@@ -23,12 +89,105 @@ typedef struct {
     // Page stack
     pman_page_stack_t page_stack;
 
+    // Page descriptors indexed by id
+    const pman_page_t *registry;
+    size_t             registry_size;
+
+#if PMAN_STATE_CACHE_SIZE > 0
+    // States of destroyed pages that can be revalidated instead of created again
+    pman_state_cache_t state_cache;
+#endif
+
 #ifndef PMAN_EXCLUDE_LVGL
-    // Reference to the touch input device; used to reset the touch state when changing page
-    lv_indev_t *touch_indev;
+    // Display the pages are shown on; NULL for the default one
+    pman_display_t *display;
+
+    // Input devices of the display; their state is reset when changing page
+    lv_indev_t *indevs[PMAN_MAX_INPUT_DEVICES];
+    size_t      indev_count;
+
+    // Timers created by the pages
+    pman_timer_wheel_t timer_wheel;
+
+    // Timer calling `pman_poll`, if a poll period is set
+    lv_timer_t *poll_timer;
+
+    // Timer running the build steps of the current page
+    lv_timer_t *build_timer;
+
+#if PMAN_SCREEN_RETENTION > 0
+    // Screen animations by kind of navigation
+    pman_animation_t animations[PMAN_ANIMATION_NUM];
+    // Animation of the navigation in progress, played when its destination page is opened
+    const pman_animation_t *next_animation;
+    // Pages waiting for their screen to animate out of view before being destroyed
+    struct pman_deferred_destroy *deferred_destroys;
+#endif
+#endif
+
+    // Last instance number assigned to a stack entry
+    uint32_t last_instance;
+
+    // Entry being created while not on top of the stack (e.g. a preloaded page); functions taking the handle refer to
+    // it instead of the top
+    pman_stack_entry_t *building;
+
+#if PMAN_PRELOAD_SLOTS > 0
+    // Pages waiting to be pushed, oldest first
+    pman_preload_t preloads[PMAN_PRELOAD_SLOTS];
+    size_t         preload_count;
+#ifndef PMAN_EXCLUDE_LVGL
+    lv_timer_t *preload_timer;
+#endif
+    // Milliseconds clock for PMAN_PRELOAD_TTL
+    uint32_t (*preload_clock)(void);
 #endif
 
-    // Callback to process user messages (i.e. system commands)
+#if PMAN_TRANSITION_QUEUE_SIZE > 0
+    // Stack messages waiting to be applied by `pman_poll`
+    pman_stack_msg_t transition_queue[PMAN_TRANSITION_QUEUE_SIZE];
+    size_t           transition_head;
+    size_t           transition_count;
+#ifndef PMAN_EXCLUDE_LVGL
+    lv_timer_t *transition_timer;
+#endif
+#endif
+
+#if PMAN_EVENT_QUEUE_SIZE > 0
+    // User events posted from other threads, waiting to be dispatched
+    pman_event_queue_t event_queue;
+    // Events of a batch whose page changed while it was dispatched, keyed again against the new page
+    void  *rekeyed_events[PMAN_EVENT_COALESCE_BATCH];
+    size_t rekeyed_count;
+#endif
+
+#if PMAN_ASYNC_JOBS
+    // Runs jobs away from the UI thread (e.g. on a worker pool); if NULL they run inline when started
+    int (*executor)(pman_job_t *job, void *arg);
+    void *executor_arg;
+    // Jobs completed by the executor, waiting to be delivered
+    pman_event_queue_t job_queue;
+    // Jobs started and not yet popped from `job_queue`, which therefore can never overflow
+    size_t jobs_in_flight;
+    // Completed jobs of pages that are covered on the stack
+    pman_job_t *parked_jobs;
+#ifndef PMAN_EXCLUDE_LVGL
+    // Timer delivering completed jobs, paused when none is expected
+    lv_timer_t *job_timer;
+#endif
+#endif
+
+#if PMAN_STATS_MAX_PAGES > 0
+    // Runtime counters by page id
+    pman_stats_t stats;
+#endif
+
+#if PMAN_TRACE_SIZE > 0
+    // Most recent callback invocations
+    pman_trace_t trace;
+#endif
+
+    // Callback to process user messages (i.e. system commands); not called for NULL messages
     pman_user_msg_cb_t user_msg_cb;
 
     // If present, called every time a page is closed
@@ -48,25 +207,98 @@ void pman_init(pman_t *pman, void *user_data,
 #endif
                pman_user_msg_cb_t user_msg_cb, void (*close_global_cb)(void *handle),
                uint8_t (*event_global_cb)(void *handle, pman_event_t event));
+void    pman_deinit(pman_t *pman);
 void    pman_change_page(pman_t *pman, pman_page_t page);
 void    pman_change_page_extra(pman_t *pman, pman_page_t newpage, void *extra);
+int     pman_change_page_id(pman_t *pman, int id, void *extra);
+void    pman_push_page_lazy(pman_t *pman, pman_page_t newpage, void *extra);
 void    pman_back(pman_t *pman);
+void    pman_back_n(pman_t *pman, size_t n);
+void    pman_back_to_depth(pman_t *pman, size_t depth);
 void    pman_rebase_page(pman_t *pman, pman_page_t newpage);
 void    pman_rebase_page_extra(pman_t *pman, pman_page_t newpage, void *extra);
+int     pman_rebase_page_id(pman_t *pman, int id, void *extra);
 void    pman_swap_page(pman_t *pman, pman_page_t newpage);
 void    pman_swap_page_extra(pman_t *pman, pman_page_t newpage, void *extra);
+int     pman_swap_page_id(pman_t *pman, int id, void *extra);
+void    pman_set_registry(pman_t *pman, const pman_page_t *pages, size_t count);
+const pman_page_t *pman_get_registered_page(pman_t *pman, int id);
 void    pman_reset_to_page_id(pman_t *pman, int id, uint8_t *found);
+int     pman_find_page_id(pman_t *pman, int id);
+size_t  pman_get_peak_depth(pman_t *pman, uint8_t reset);
+#ifdef PMAN_EXCLUDE_LVGL
+void pman_set_heap_allocator(void *(*alloc_fn)(size_t size), void (*free_fn)(void *ptr));
+#endif
+size_t  pman_snapshot(pman_t *pman, uint8_t *buffer, size_t size);
+int     pman_restore(pman_t *pman, const uint8_t *data, size_t size, const pman_page_t *(*find_page)(int id));
 void    pman_event(pman_t *pman, pman_event_t event);
+void    pman_poll(pman_t *pman);
+#if PMAN_EVENT_QUEUE_SIZE > 0
+int    pman_post_event(pman_t *pman, void *user);
+size_t pman_drain_events(pman_t *pman);
+void   pman_get_event_queue_stats(pman_t *pman, pman_event_queue_stats_t *stats);
+#endif
+#if PMAN_ASYNC_JOBS
+void pman_set_executor(pman_t *pman, int (*executor)(pman_job_t *job, void *arg), void *arg);
+int  pman_start_job(pman_handle_t handle, int id, void *(*work)(void *arg), void *arg,
+                    void (*discard)(void *result, void *arg));
+void pman_run_job(pman_job_t *job);
+#endif
 void    pman_destroy_all(void *state, void *extra);
 void    pman_close_all(void *state);
 void   *pman_get_user_data(pman_handle_t handle);
 uint8_t pman_is_current_page_id(pman_t *pman, int id);
+#ifndef PMAN_PAGE_STACK_DEPTH
+void pman_set_page_stack_allocator(pman_t *pman, void *(*realloc_fn)(void *ptr, size_t size),
+                                   void (*free_fn)(void *ptr));
+void pman_shrink_page_stack(pman_t *pman);
+#endif
+void   *pman_arena_alloc(pman_handle_t handle, size_t size);
+void   *pman_view_arena_alloc(pman_handle_t handle, size_t size);
 int     pman_get_current_page_id(pman_t *pman);
+#if PMAN_STATE_CACHE_SIZE > 0
+void pman_state_cache_flush(pman_t *pman);
+#endif
+#if PMAN_PRELOAD_SLOTS > 0
+void pman_preload(pman_t *pman, pman_page_t page, void *extra);
+int  pman_preload_id(pman_t *pman, int id, void *extra);
+void pman_preload_flush(pman_t *pman);
+void pman_set_preload_clock(pman_t *pman, uint32_t (*clock)(void));
+#endif
+#if PMAN_STATS_MAX_PAGES > 0
+size_t pman_get_stats(pman_t *pman, pman_page_stats_t *stats, size_t num);
+void   pman_reset_stats(pman_t *pman);
+void   pman_set_stats_clock(pman_t *pman, uint32_t (*clock)(void));
+#endif
+#if PMAN_TRACE_SIZE > 0
+void   pman_set_trace_clock(pman_t *pman, uint64_t (*clock_us)(void));
+void   pman_set_trace_enabled(pman_t *pman, uint8_t value);
+void   pman_clear_trace(pman_t *pman);
+size_t pman_read_trace(pman_t *pman, pman_trace_record_t *records, size_t num);
+void   pman_dump_trace_json(pman_t *pman, void (*write)(const char *data, size_t len, void *arg), void *arg);
+void   pman_dump_trace_binary(pman_t *pman, void (*write)(const char *data, size_t len, void *arg), void *arg);
+#endif
 #ifndef PMAN_EXCLUDE_LVGL
+void pman_set_display(pman_t *pman, pman_display_t *display);
+#if PMAN_SCREEN_RETENTION > 0
+void pman_set_animation(pman_t *pman, pman_animation_kind_t kind, lv_scr_load_anim_t anim, uint32_t time);
+#endif
+int  pman_add_input_device(pman_t *pman, lv_indev_t *indev);
+void pman_set_poll_period(pman_t *pman, uint32_t period);
 void pman_register_obj_event(pman_handle_t handle, lv_obj_t *obj, lv_event_code_t event);
 void pman_unregister_obj_event(lv_obj_t *obj);
 void pman_set_obj_self_destruct(lv_obj_t *obj);
+void *pman_alloc_obj_user_data(size_t size);
+void *pman_alloc_state(size_t size);
+void  pman_get_pool_stats(pman_pool_id_t pool, pman_pool_stats_t *stats);
+#if PMAN_SCREEN_RETENTION > 0
+uint8_t pman_is_screen_retained(pman_handle_t handle);
+#endif
+lv_obj_t *pman_get_screen(pman_handle_t handle);
 void pman_register_obj_id_and_number(pman_handle_t handle, lv_obj_t *obj, int id, int number);
+void pman_register_obj_delegate(pman_handle_t handle, lv_obj_t *container, lv_event_code_t event);
+int  pman_get_obj_id(lv_obj_t *obj);
+int  pman_get_obj_number(lv_obj_t *obj);
 
 void         *pman_timer_get_user_data(pman_timer_t *timer);
 pman_timer_t *pman_timer_create(pman_handle_t handle, uint32_t period, void *user_data);
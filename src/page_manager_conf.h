@@ -2,9 +2,130 @@
 #define PMAN_CONF_H_INCLUDED
 
 
-#ifndef PMAN_PAGE_STACK_DEPTH
+#ifndef PMAN_DYNAMIC_PAGE_STACK
+#define PMAN_DYNAMIC_PAGE_STACK 0
+#endif
+
+#if PMAN_DYNAMIC_PAGE_STACK
+#ifdef PMAN_PAGE_STACK_DEPTH
+#error "PMAN_PAGE_STACK_DEPTH and PMAN_DYNAMIC_PAGE_STACK are mutually exclusive"
+#endif
+
+#ifndef PMAN_PAGE_STACK_INITIAL_CAPACITY
+#define PMAN_PAGE_STACK_INITIAL_CAPACITY 4
+#endif
+
+#ifndef PMAN_PAGE_STACK_MAX_DEPTH
+#define PMAN_PAGE_STACK_MAX_DEPTH 0
+#endif
+#elif !defined(PMAN_PAGE_STACK_DEPTH)
 #define PMAN_PAGE_STACK_DEPTH 16
 #endif
 
+#ifndef PMAN_PAGE_REGISTRY
+#define PMAN_PAGE_REGISTRY 0
+#endif
+
+#ifndef PMAN_BOUNDED_HISTORY
+#define PMAN_BOUNDED_HISTORY 0
+#endif
+
+#ifndef PMAN_TIMER_RESOLUTION
+#define PMAN_TIMER_RESOLUTION 10
+#endif
+
+#ifndef PMAN_TIMER_WHEEL_SLOTS
+#define PMAN_TIMER_WHEEL_SLOTS 32
+#endif
+
+#ifndef PMAN_TIMER_POOL_SIZE
+#define PMAN_TIMER_POOL_SIZE 0
+#endif
+
+#ifndef PMAN_USER_DATA_POOL_SIZE
+#define PMAN_USER_DATA_POOL_SIZE 0
+#endif
+
+#ifndef PMAN_USER_DATA_BLOCK_SIZE
+#define PMAN_USER_DATA_BLOCK_SIZE 16
+#endif
+
+#ifndef PMAN_STATE_POOL_SIZE
+#define PMAN_STATE_POOL_SIZE 0
+#endif
+
+#ifndef PMAN_STATE_BLOCK_SIZE
+#define PMAN_STATE_BLOCK_SIZE 64
+#endif
+
+#ifndef PMAN_ARENA_CHUNK_SIZE
+#define PMAN_ARENA_CHUNK_SIZE 256
+#endif
+
+#ifndef PMAN_STATE_CACHE_SIZE
+#define PMAN_STATE_CACHE_SIZE 0
+#endif
+
+#ifndef PMAN_STATE_CACHE_BUDGET
+#define PMAN_STATE_CACHE_BUDGET 0
+#endif
+
+#ifndef PMAN_TRANSITION_QUEUE_SIZE
+#define PMAN_TRANSITION_QUEUE_SIZE 0
+#endif
+
+#ifndef PMAN_EVENT_QUEUE_SIZE
+#define PMAN_EVENT_QUEUE_SIZE 0
+#endif
+
+#ifndef PMAN_EVENT_COALESCE_BATCH
+#define PMAN_EVENT_COALESCE_BATCH 16
+#endif
+
+#ifndef PMAN_ASYNC_JOBS
+#define PMAN_ASYNC_JOBS 0
+#endif
+
+#ifndef PMAN_SCREEN_RETENTION
+#define PMAN_SCREEN_RETENTION 0
+#endif
+
+#ifndef PMAN_BUILD_SLICE_TIME
+#define PMAN_BUILD_SLICE_TIME 5
+#endif
+
+#ifndef PMAN_PRELOAD_SLOTS
+#define PMAN_PRELOAD_SLOTS 0
+#endif
+
+#ifndef PMAN_PRELOAD_TTL
+#define PMAN_PRELOAD_TTL 0
+#endif
+
+#ifndef PMAN_PRELOAD_BUDGET
+#define PMAN_PRELOAD_BUDGET 0
+#endif
+
+#ifndef PMAN_MAX_INPUT_DEVICES
+#define PMAN_MAX_INPUT_DEVICES 1
+#endif
+
+#ifndef PMAN_TRACE_SIZE
+#define PMAN_TRACE_SIZE 0
+#endif
+
+#ifndef PMAN_STATS_MAX_PAGES
+#define PMAN_STATS_MAX_PAGES 0
+#endif
+
+// Reports misuse that release builds tolerate, e.g. stack messages to unregistered page ids
+#ifndef PMAN_LOG_WARN
+#ifndef PMAN_EXCLUDE_LVGL
+#define PMAN_LOG_WARN(...) LV_LOG_WARN(__VA_ARGS__)
+#else
+#define PMAN_LOG_WARN(...)
+#endif
+#endif
+
 
 #endif
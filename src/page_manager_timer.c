@@ -0,0 +1,223 @@
+#include <stdint.h>
+#include "page_manager_timer.h"
+#include "page.h"
+
+
+#ifndef PMAN_EXCLUDE_LVGL
+
+
+#define SLOT(time) (((time) / PMAN_TIMER_RESOLUTION) & (PMAN_TIMER_WHEEL_SLOTS - 1))
+
+
+static void    arm(pman_timer_wheel_t *wheel, pman_timer_t *timer);
+static void    disarm(pman_timer_wheel_t *wheel, pman_timer_t *timer);
+static uint8_t fire_slot(pman_timer_wheel_t *wheel, size_t slot, uint32_t now);
+static void    tick_callback(lv_timer_t *timer);
+
+
+void pman_timer_wheel_init(pman_timer_wheel_t *wheel, void (*fire_cb)(struct pman_timer *timer)) {
+    for (size_t i = 0; i < PMAN_TIMER_WHEEL_SLOTS; i++) {
+        wheel->slots[i] = NULL;
+    }
+    wheel->timers     = NULL;
+    wheel->tick_timer = NULL;
+    wheel->armed      = 0;
+    wheel->current    = 0;
+    wheel->pass       = 0;
+    wheel->fire_cb    = fire_cb;
+}
+
+
+/**
+ * @brief Deletes the LVGL timer driving the wheel; the timers must have been removed already
+ *
+ * @param wheel
+ */
+void pman_timer_wheel_deinit(pman_timer_wheel_t *wheel) {
+    if (wheel->tick_timer != NULL) {
+        lv_timer_del(wheel->tick_timer);
+        wheel->tick_timer = NULL;
+    }
+}
+
+
+/**
+ * @brief Adds a timer to the wheel, arming it if it is running
+ *
+ * @param wheel
+ * @param timer
+ */
+void pman_timer_wheel_add(pman_timer_wheel_t *wheel, pman_timer_t *timer) {
+    timer->armed = 0;
+    timer->prev  = NULL;
+    timer->next  = wheel->timers;
+    if (wheel->timers != NULL) {
+        wheel->timers->prev = timer;
+    }
+    wheel->timers = timer;
+
+    pman_timer_wheel_update(wheel, timer);
+}
+
+
+void pman_timer_wheel_remove(pman_timer_wheel_t *wheel, pman_timer_t *timer) {
+    disarm(wheel, timer);
+
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel->timers = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+}
+
+
+/**
+ * @brief Reschedules a timer after its state, period or last run time changed
+ *
+ * @param wheel
+ * @param timer
+ */
+void pman_timer_wheel_update(pman_timer_wheel_t *wheel, pman_timer_t *timer) {
+    disarm(wheel, timer);
+    if (!timer->paused && !timer->suspended) {
+        arm(wheel, timer);
+    }
+}
+
+
+/**
+ * @brief Suspends or resumes all timers created by a stack entry
+ *
+ * @param wheel
+ * @param owner
+ * @param suspend
+ */
+void pman_timer_wheel_suspend_owner(pman_timer_wheel_t *wheel, uint32_t owner, uint8_t suspend) {
+    for (pman_timer_t *timer = wheel->timers; timer != NULL; timer = timer->next) {
+        if (timer->owner == owner) {
+            timer->suspended = suspend;
+            pman_timer_wheel_update(wheel, timer);
+        }
+    }
+}
+
+
+/**
+ * @brief Removes from the wheel one of the timers created by a stack entry
+ *
+ * @param wheel
+ * @param owner
+ * @return pman_timer_t* the removed timer, NULL if there are none left
+ */
+pman_timer_t *pman_timer_wheel_take_owner(pman_timer_wheel_t *wheel, uint32_t owner) {
+    for (pman_timer_t *timer = wheel->timers; timer != NULL; timer = timer->next) {
+        if (timer->owner == owner) {
+            pman_timer_wheel_remove(wheel, timer);
+            return timer;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Fires all timers expired up to `now`. Only the slots between the last processed time and `now` are scanned.
+ *
+ * @param wheel
+ * @param now
+ */
+void pman_timer_wheel_advance(pman_timer_wheel_t *wheel, uint32_t now) {
+    uint32_t from  = wheel->current / PMAN_TIMER_RESOLUTION;
+    uint32_t to    = now / PMAN_TIMER_RESOLUTION;
+    uint32_t ticks = to - from;
+
+    if (ticks >= PMAN_TIMER_WHEEL_SLOTS) {
+        from = to - (PMAN_TIMER_WHEEL_SLOTS - 1);
+    }
+
+    wheel->current = now;
+    // Timers are fired at most once per pass, even if they are made ready by a callback
+    wheel->pass++;
+
+    for (uint32_t tick = from; tick != to + 1; tick++) {
+        while (fire_slot(wheel, tick & (PMAN_TIMER_WHEEL_SLOTS - 1), now)) {
+            // Callbacks may change the slot lists, so the scan restarts after every fired timer
+        }
+    }
+}
+
+
+static uint8_t fire_slot(pman_timer_wheel_t *wheel, size_t slot, uint32_t now) {
+    for (pman_timer_t *timer = wheel->slots[slot]; timer != NULL; timer = timer->wheel_next) {
+        if ((int32_t)(now - timer->expire) >= 0 && timer->pass != wheel->pass) {
+            timer->pass     = wheel->pass;
+            timer->last_run = now;
+            pman_timer_wheel_update(wheel, timer);
+
+            wheel->fire_cb(timer);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static void arm(pman_timer_wheel_t *wheel, pman_timer_t *timer) {
+    uint32_t now    = lv_tick_get();
+    uint32_t period = timer->period > 0 ? timer->period : 1;
+
+    timer->expire = timer->last_run + period;
+    if ((int32_t)(timer->expire - now) < 0) {
+        timer->expire = now;
+    }
+
+    size_t slot       = SLOT(timer->expire);
+    timer->wheel_prev = NULL;
+    timer->wheel_next = wheel->slots[slot];
+    if (wheel->slots[slot] != NULL) {
+        wheel->slots[slot]->wheel_prev = timer;
+    }
+    wheel->slots[slot] = timer;
+    timer->armed       = 1;
+
+    if (wheel->armed++ == 0) {
+        wheel->current = now;
+        if (wheel->tick_timer == NULL) {
+            wheel->tick_timer = lv_timer_create(tick_callback, PMAN_TIMER_RESOLUTION, wheel);
+        } else {
+            lv_timer_resume(wheel->tick_timer);
+        }
+    }
+}
+
+
+static void disarm(pman_timer_wheel_t *wheel, pman_timer_t *timer) {
+    if (!timer->armed) {
+        return;
+    }
+
+    if (timer->wheel_prev != NULL) {
+        timer->wheel_prev->wheel_next = timer->wheel_next;
+    } else {
+        wheel->slots[SLOT(timer->expire)] = timer->wheel_next;
+    }
+    if (timer->wheel_next != NULL) {
+        timer->wheel_next->wheel_prev = timer->wheel_prev;
+    }
+    timer->armed = 0;
+
+    if (--wheel->armed == 0 && wheel->tick_timer != NULL) {
+        lv_timer_pause(wheel->tick_timer);
+    }
+}
+
+
+static void tick_callback(lv_timer_t *timer) {
+    pman_timer_wheel_advance(lv_timer_get_user_data(timer), lv_tick_get());
+}
+
+
+#endif
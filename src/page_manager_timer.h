@@ -2,9 +2,52 @@
 #define PMAN_TIMER_H_INCLUDED
 
 
+#include <stdint.h>
+#include "page_manager_conf.h"
 #ifndef PMAN_EXCLUDE_LVGL
 #include "lvgl.h"
 #endif
 
 
+#ifndef PMAN_EXCLUDE_LVGL
+
+#if (PMAN_TIMER_WHEEL_SLOTS & (PMAN_TIMER_WHEEL_SLOTS - 1)) != 0
+#error "PMAN_TIMER_WHEEL_SLOTS must be a power of 2"
+#endif
+
+
+struct pman_timer;
+
+
+/**
+ * @brief Hashed timer wheel multiplexing all the timers of a page manager on a single LVGL timer
+ *
+ */
+typedef struct {
+    // Armed timers, by expiration tick
+    struct pman_timer *slots[PMAN_TIMER_WHEEL_SLOTS];
+    // All timers, armed or not
+    struct pman_timer *timers;
+    // LVGL timer driving the wheel; paused when nothing is armed
+    lv_timer_t *tick_timer;
+    size_t      armed;
+    // Time up to which the wheel has been processed
+    uint32_t current;
+    uint32_t pass;
+    // Called for every expired timer
+    void (*fire_cb)(struct pman_timer *timer);
+} pman_timer_wheel_t;
+
+
+void               pman_timer_wheel_init(pman_timer_wheel_t *wheel, void (*fire_cb)(struct pman_timer *timer));
+void               pman_timer_wheel_deinit(pman_timer_wheel_t *wheel);
+void               pman_timer_wheel_add(pman_timer_wheel_t *wheel, struct pman_timer *timer);
+void               pman_timer_wheel_remove(pman_timer_wheel_t *wheel, struct pman_timer *timer);
+void               pman_timer_wheel_update(pman_timer_wheel_t *wheel, struct pman_timer *timer);
+void               pman_timer_wheel_suspend_owner(pman_timer_wheel_t *wheel, uint32_t owner, uint8_t suspend);
+struct pman_timer *pman_timer_wheel_take_owner(pman_timer_wheel_t *wheel, uint32_t owner);
+void               pman_timer_wheel_advance(pman_timer_wheel_t *wheel, uint32_t now);
+#endif
+
+
 #endif
@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include "pool.h"
+
+
+/**
+ * @brief Takes a block from the pool
+ *
+ * @param pool
+ * @param size requested size, only used to check that it fits the block
+ * @return void* NULL if the pool is exhausted or the block is too small; the fallback is counted in the statistics
+ */
+void *pman_pool_alloc(pman_pool_t *pool, size_t size) {
+    void *block = NULL;
+
+    if (size <= pool->block_size) {
+        if (pool->free_list != NULL) {
+            block           = pool->free_list;
+            pool->free_list = *(void **)block;
+        } else if (pool->next_unused < pool->capacity) {
+            block = &pool->blocks[pool->next_unused++ * pool->block_size];
+        }
+    }
+
+    if (block == NULL) {
+        pool->fallbacks++;
+        return NULL;
+    }
+
+    if (++pool->used > pool->high_water) {
+        pool->high_water = pool->used;
+    }
+    return block;
+}
+
+
+/**
+ * @brief Returns a block to the pool
+ *
+ * @param pool
+ * @param ptr
+ * @return int 0 on success, -1 if the pointer doesn't belong to the pool
+ */
+int pman_pool_free(pman_pool_t *pool, void *ptr) {
+    if (!pman_pool_owns(pool, ptr)) {
+        return -1;
+    }
+
+    *(void **)ptr   = pool->free_list;
+    pool->free_list = ptr;
+    pool->used--;
+    return 0;
+}
+
+
+uint8_t pman_pool_owns(pman_pool_t *pool, void *ptr) {
+    uint8_t *byte = ptr;
+    return pool->capacity > 0 && byte >= pool->blocks && byte < pool->blocks + pool->capacity * pool->block_size;
+}
+
+
+void pman_pool_get_stats(pman_pool_t *pool, pman_pool_stats_t *stats) {
+    stats->block_size = pool->block_size;
+    stats->capacity   = pool->capacity;
+    stats->used       = pool->used;
+    stats->high_water = pool->high_water;
+    stats->fallbacks  = pool->fallbacks;
+}
@@ -0,0 +1,61 @@
+#ifndef PMAN_POOL_H_INCLUDED
+#define PMAN_POOL_H_INCLUDED
+
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+#define PMAN_POOL_ALIGN(size) ((((size) + sizeof(uint64_t) - 1) / sizeof(uint64_t)) * sizeof(uint64_t))
+
+// Declares the storage for a pool of `capacity` blocks of `size` bytes
+#define PMAN_POOL_BUFFER(name, size, capacity)                                                                         \
+    static uint64_t name[(PMAN_POOL_ALIGN(size) * (capacity)) / sizeof(uint64_t)]
+
+// Static initializer for a pool over a buffer declared with PMAN_POOL_BUFFER; no further initialization is required
+#define PMAN_POOL_INIT(buffer_, size_, capacity_)                                                                      \
+    {                                                                                                                  \
+        .blocks = (uint8_t *)(buffer_), .block_size = PMAN_POOL_ALIGN(size_), .capacity = (capacity_),                 \
+        .next_unused = 0, .free_list = NULL, .used = 0, .high_water = 0, .fallbacks = 0,                               \
+    }
+
+
+/**
+ * @brief Fixed-size block allocator over a static buffer
+ *
+ */
+typedef struct {
+    uint8_t *blocks;
+    size_t   block_size;
+    size_t   capacity;
+    // Blocks past this index were never allocated and are not in the free list
+    size_t next_unused;
+    void  *free_list;
+
+    size_t   used;
+    size_t   high_water;
+    uint32_t fallbacks;
+} pman_pool_t;
+
+
+/**
+ * @brief Pool statistics
+ *
+ */
+typedef struct {
+    size_t   block_size;
+    size_t   capacity;
+    size_t   used;
+    size_t   high_water;
+    // Allocations that didn't fit the pool and went to the heap instead
+    uint32_t fallbacks;
+} pman_pool_stats_t;
+
+
+void   *pman_pool_alloc(pman_pool_t *pool, size_t size);
+int     pman_pool_free(pman_pool_t *pool, void *ptr);
+uint8_t pman_pool_owns(pman_pool_t *pool, void *ptr);
+void    pman_pool_get_stats(pman_pool_t *pool, pman_pool_stats_t *stats);
+
+
+#endif
@@ -1,38 +1,98 @@
 #include <stdint.h>
+#include <string.h>
 #include "stack.h"
 
 
 #ifdef PMAN_PAGE_STACK_DEPTH
 #define ARRAY_LENGTH(stack) PMAN_PAGE_STACK_DEPTH
 #else
-#define ARRAY_LENGTH(stack) 0
+#define ARRAY_LENGTH(stack) ((stack)->num)
+
+static int resize(pman_page_stack_t *pstack, size_t capacity);
 #endif
 
+// Items are kept in a ring starting at `start`, so that the bottom can be dropped without moving the others
+#define SLOT(stack, depth) (((stack)->start + (depth)) % ARRAY_LENGTH(stack))
+
+// The id index is an open addressing table kept at most half full
+#define INDEX_LENGTH(stack)        (ARRAY_LENGTH(stack) * 2)
+#define INDEX_HOME(stack, id)      (((uint32_t)(id)*2654435761UL) % INDEX_LENGTH(stack))
+#define POSITION(stack, depth)     ((stack)->base + (depth) + 1)
+#define POSITION_DEPTH(stack, pos) ((pos) - (stack)->base - 1)
+
+static pman_page_id_index_slot_t *index_lookup(pman_page_stack_t *pstack, int id);
+static void                       index_remove(pman_page_stack_t *pstack, pman_page_id_index_slot_t *slot);
+static void                       index_push(pman_page_stack_t *pstack, size_t depth);
+
 
 void pman_page_stack_init(pman_page_stack_t *pstack) {
     pstack->index = 0;
+    pstack->num   = 0;
+    pstack->start = 0;
+    pstack->base  = 0;
+    pstack->peak  = 0;
+#ifdef PMAN_PAGE_STACK_DEPTH
+    memset(pstack->id_index, 0, sizeof(pstack->id_index));
+#else
+    pstack->items      = NULL;
+    pstack->id_index   = NULL;
+    pstack->realloc_fn = realloc;
+    pstack->free_fn    = free;
+#endif
 }
 
 
-pman_page_t *pman_page_stack_push(pman_page_stack_t *pstack, pman_page_t *ppage) {
+/**
+ * @brief Pushes a copy of the page on the stack. A dynamic stack grows as needed, doubling its capacity up to
+ * PMAN_PAGE_STACK_MAX_DEPTH (if not 0); pointers to the pages already on the stack are invalidated when it does.
+ *
+ * @param pstack
+ * @param pentry
+ * @return pman_stack_entry_t* the page on the stack, NULL if the stack is full
+ */
+pman_stack_entry_t *pman_page_stack_push(pman_page_stack_t *pstack, pman_stack_entry_t *pentry) {
     if (pstack->index == ARRAY_LENGTH(pstack)) {
+#ifdef PMAN_PAGE_STACK_DEPTH
         return NULL;
+#else
+        size_t capacity = pstack->num > 0 ? pstack->num * 2 : PMAN_PAGE_STACK_INITIAL_CAPACITY;
+#if PMAN_PAGE_STACK_MAX_DEPTH > 0
+        if (capacity > PMAN_PAGE_STACK_MAX_DEPTH) {
+            capacity = PMAN_PAGE_STACK_MAX_DEPTH;
+        }
+#endif
+        if (capacity <= pstack->num || resize(pstack, capacity) != 0) {
+            return NULL;
+        }
+#endif
     }
 
-    size_t page_index         = pstack->index++;
-    pstack->items[page_index] = *ppage;
+    size_t slot         = SLOT(pstack, pstack->index);
+    pstack->items[slot] = *pentry;
+    index_push(pstack, pstack->index++);
+    if (pstack->index > pstack->peak) {
+        pstack->peak = pstack->index;
+    }
 
-    return &pstack->items[page_index];
+    return &pstack->items[slot];
 }
 
 
-int pman_page_stack_pop(pman_page_stack_t *pstack, pman_page_t *ppage) {
+int pman_page_stack_pop(pman_page_stack_t *pstack, pman_stack_entry_t *pentry) {
     if (pstack->index == 0) {
         return -1;
     }
 
-    if (ppage) {
-        *ppage = pstack->items[pstack->index - 1];
+    pman_stack_entry_t        *top  = &pstack->items[SLOT(pstack, pstack->index - 1)];
+    pman_page_id_index_slot_t *slot = index_lookup(pstack, PMAN_ENTRY_PAGE(top)->id);
+    if (top->id_link == 0) {
+        index_remove(pstack, slot);
+    } else {
+        slot->position = top->id_link;
+    }
+
+    if (pentry) {
+        *pentry = *top;
     }
     pstack->index--;
 
@@ -40,23 +100,91 @@ int pman_page_stack_pop(pman_page_stack_t *pstack, pman_page_t *ppage) {
 }
 
 
-pman_page_t *pman_page_stack_top(pman_page_stack_t *pstack) {
+pman_stack_entry_t *pman_page_stack_top(pman_page_stack_t *pstack) {
     if (pstack->index == 0) {
         return NULL;
     }
 
-    return &pstack->items[pstack->index - 1];
+    return &pstack->items[SLOT(pstack, pstack->index - 1)];
+}
+
+
+/**
+ * @brief Returns the page at the given depth, counting from the bottom of the stack
+ *
+ * @param pstack
+ * @param depth
+ * @return pman_stack_entry_t* NULL if the depth is out of bounds
+ */
+pman_stack_entry_t *pman_page_stack_at(pman_page_stack_t *pstack, size_t depth) {
+    if (depth >= pstack->index) {
+        return NULL;
+    }
+
+    return &pstack->items[SLOT(pstack, depth)];
+}
+
+
+size_t pman_page_stack_size(pman_page_stack_t *pstack) {
+    return pstack->index;
+}
+
+
+/**
+ * @brief Finds the highest page with the given id in constant time
+ *
+ * @param pstack
+ * @param id
+ * @return int the depth of the page counting from the bottom of the stack, -1 if there is none
+ */
+int pman_page_stack_find(pman_page_stack_t *pstack, int id) {
+    if (pstack->index == 0) {
+        return -1;
+    }
+
+    pman_page_id_index_slot_t *slot = index_lookup(pstack, id);
+    if (slot->position == 0) {
+        return -1;
+    } else {
+        return (int)POSITION_DEPTH(pstack, slot->position);
+    }
 }
 
 
-void pman_page_stack_dequeue(pman_page_stack_t *pstack) {
-    if (pstack->index > 0) {
-        for (size_t i = 0; i < pstack->index - 1; i++) {
-            pstack->items[i] = pstack->items[i + 1];
+/**
+ * @brief Removes the page at the bottom of the stack
+ *
+ * @param pstack
+ * @param pentry where the removed page is copied (if not NULL)
+ * @return int 0 on success, -1 if the stack is empty
+ */
+int pman_page_stack_dequeue(pman_page_stack_t *pstack, pman_stack_entry_t *pentry) {
+    if (pstack->index == 0) {
+        return -1;
+    }
+
+    pman_stack_entry_t        *bottom   = &pstack->items[pstack->start];
+    size_t const               position = POSITION(pstack, 0);
+    pman_page_id_index_slot_t *slot     = index_lookup(pstack, PMAN_ENTRY_PAGE(bottom)->id);
+    if (slot->position == position) {
+        index_remove(pstack, slot);
+    } else {
+        // Unlink it from the chain of pages with the same id, of which it is the last
+        pman_stack_entry_t *entry = pman_page_stack_at(pstack, POSITION_DEPTH(pstack, slot->position));
+        while (entry->id_link != position) {
+            entry = pman_page_stack_at(pstack, POSITION_DEPTH(pstack, entry->id_link));
         }
+        entry->id_link = 0;
+    }
 
-        pstack->index--;
+    if (pentry) {
+        *pentry = *bottom;
     }
+    pstack->start = SLOT(pstack, 1);
+    pstack->base++;
+    pstack->index--;
+
+    return 0;
 }
 
 
@@ -66,6 +194,173 @@ uint8_t pman_page_stack_is_empty(pman_page_stack_t *pstack) {
 
 
 uint8_t pman_page_stack_is_full(pman_page_stack_t *pstack) {
-    size_t const capacity = ARRAY_LENGTH(pstack->items);
+    size_t const capacity = ARRAY_LENGTH(pstack);
+#if !defined(PMAN_PAGE_STACK_DEPTH) && PMAN_PAGE_STACK_MAX_DEPTH == 0
+    (void)capacity;
+    return 0;
+#elif !defined(PMAN_PAGE_STACK_DEPTH)
+    return pstack->index == capacity && capacity == PMAN_PAGE_STACK_MAX_DEPTH;
+#else
     return pstack->index == capacity;
+#endif
+}
+
+
+/**
+ * @brief Returns the highest number of pages the stack held since it was initialized or the peak was last reset
+ *
+ * @param pstack
+ * @param reset if not 0 the peak restarts from the current size
+ * @return size_t
+ */
+size_t pman_page_stack_peak(pman_page_stack_t *pstack, uint8_t reset) {
+    size_t peak = pstack->peak;
+    if (reset) {
+        pstack->peak = pstack->index;
+    }
+    return peak;
+}
+
+
+#ifndef PMAN_PAGE_STACK_DEPTH
+/**
+ * @brief Sets the functions used to allocate the items of a dynamic stack. Must be called while the stack is empty.
+ *
+ * @param pstack
+ * @param realloc_fn
+ * @param free_fn
+ */
+void pman_page_stack_set_allocator(pman_page_stack_t *pstack, void *(*realloc_fn)(void *ptr, size_t size),
+                                   void (*free_fn)(void *ptr)) {
+    pman_page_stack_deinit(pstack);
+    pstack->realloc_fn = realloc_fn;
+    pstack->free_fn    = free_fn;
+}
+
+
+/**
+ * @brief Reduces the capacity of a dynamic stack to its current size
+ *
+ * @param pstack
+ * @return int 0 on success, -1 if the reallocation failed (the stack is left untouched)
+ */
+int pman_page_stack_shrink_to_fit(pman_page_stack_t *pstack) {
+    if (pstack->index == pstack->num) {
+        return 0;
+    } else if (pstack->index == 0) {
+        pman_page_stack_deinit(pstack);
+        return 0;
+    } else {
+        return resize(pstack, pstack->index);
+    }
+}
+
+
+/**
+ * @brief Frees the items of a dynamic stack; the pages on it are discarded without being destroyed
+ *
+ * @param pstack
+ */
+void pman_page_stack_deinit(pman_page_stack_t *pstack) {
+    if (pstack->items != NULL) {
+        pstack->free_fn(pstack->items);
+        pstack->free_fn(pstack->id_index);
+    }
+    pstack->items    = NULL;
+    pstack->id_index = NULL;
+    pstack->index    = 0;
+    pstack->num      = 0;
+    pstack->start    = 0;
+    pstack->base     = 0;
+}
+
+
+/**
+ * @brief Moves the items to a new array of the given capacity, unrolling the ring, and rebuilds the id index
+ *
+ * @param pstack
+ * @param capacity must not be lower than the number of items
+ * @return int 0 on success, -1 if the allocation failed
+ */
+static int resize(pman_page_stack_t *pstack, size_t capacity) {
+    pman_stack_entry_t *items = pstack->realloc_fn(NULL, capacity * sizeof(pman_stack_entry_t));
+    if (items == NULL) {
+        return -1;
+    }
+    pman_page_id_index_slot_t *id_index = pstack->realloc_fn(NULL, capacity * 2 * sizeof(pman_page_id_index_slot_t));
+    if (id_index == NULL) {
+        pstack->free_fn(items);
+        return -1;
+    }
+    memset(id_index, 0, capacity * 2 * sizeof(pman_page_id_index_slot_t));
+
+    for (size_t i = 0; i < pstack->index; i++) {
+        items[i] = pstack->items[SLOT(pstack, i)];
+    }
+    if (pstack->items != NULL) {
+        pstack->free_fn(pstack->items);
+        pstack->free_fn(pstack->id_index);
+    }
+
+    pstack->items    = items;
+    pstack->id_index = id_index;
+    pstack->num      = capacity;
+    pstack->start    = 0;
+
+    for (size_t i = 0; i < pstack->index; i++) {
+        index_push(pstack, i);
+    }
+    return 0;
+}
+#endif
+
+
+/**
+ * @brief Finds the index slot of the given id, or the free slot where it should be inserted
+ */
+static pman_page_id_index_slot_t *index_lookup(pman_page_stack_t *pstack, int id) {
+    size_t i = INDEX_HOME(pstack, id);
+    // There is always at least one free slot, so the probing ends
+    while (pstack->id_index[i].position != 0 && pstack->id_index[i].id != id) {
+        i = (i + 1) % INDEX_LENGTH(pstack);
+    }
+    return &pstack->id_index[i];
+}
+
+
+/**
+ * @brief Frees an index slot, shifting back the following ones so that no probe sequence is broken
+ */
+static void index_remove(pman_page_stack_t *pstack, pman_page_id_index_slot_t *slot) {
+    size_t hole = (size_t)(slot - pstack->id_index);
+    size_t i    = hole;
+
+    for (;;) {
+        i = (i + 1) % INDEX_LENGTH(pstack);
+        if (pstack->id_index[i].position == 0) {
+            break;
+        }
+
+        // The slot can fill the hole only if its home position does not lie cyclically in (hole, i]
+        size_t home = INDEX_HOME(pstack, pstack->id_index[i].id);
+        if ((i > hole && (home <= hole || home > i)) || (i < hole && home <= hole && home > i)) {
+            pstack->id_index[hole] = pstack->id_index[i];
+            hole                   = i;
+        }
+    }
+
+    pstack->id_index[hole].position = 0;
+}
+
+
+/**
+ * @brief Makes the page at the given depth the highest one with its id
+ */
+static void index_push(pman_page_stack_t *pstack, size_t depth) {
+    pman_stack_entry_t        *entry = &pstack->items[SLOT(pstack, depth)];
+    pman_page_id_index_slot_t *slot  = index_lookup(pstack, PMAN_ENTRY_PAGE(entry)->id);
+
+    entry->id_link = slot->position;
+    slot->id       = PMAN_ENTRY_PAGE(entry)->id;
+    slot->position = POSITION(pstack, depth);
 }
@@ -7,25 +7,52 @@
 #include "page.h"
 
 
+typedef struct {
+    int id;
+    // Position (plus one) of the highest entry with this id, 0 if the slot is free
+    size_t position;
+} pman_page_id_index_slot_t;
+
+
 typedef struct {
     size_t index;
     size_t num;
+    // Position of the bottom of the stack in `items`
+    size_t start;
+    // Number of items ever removed from the bottom; positions in the id index are relative to it
+    size_t base;
+    // Highest number of items reached
+    size_t peak;
 #ifdef PMAN_PAGE_STACK_DEPTH
-    pman_page_t items[PMAN_PAGE_STACK_DEPTH];
+    pman_stack_entry_t        items[PMAN_PAGE_STACK_DEPTH];
+    pman_page_id_index_slot_t id_index[PMAN_PAGE_STACK_DEPTH * 2];
 #else
-#error "TODO"
-    pman_page_t *items;
+    // `num` is the allocated capacity
+    pman_stack_entry_t        *items;
+    pman_page_id_index_slot_t *id_index;
+    void *(*realloc_fn)(void *ptr, size_t size);
+    void (*free_fn)(void *ptr);
 #endif
 } pman_page_stack_t;
 
 
-void            pman_page_stack_init(pman_page_stack_t *pstack);
-pman_page_t *pman_page_stack_push(pman_page_stack_t *pstack, pman_page_t *ppage);
-int             pman_page_stack_pop(pman_page_stack_t *pstack, pman_page_t *ppage);
-pman_page_t *pman_page_stack_top(pman_page_stack_t *pstack);
-void            pman_page_stack_dequeue(pman_page_stack_t *pstack);
-uint8_t         pman_page_stack_is_empty(pman_page_stack_t *pstack);
-uint8_t         pman_page_stack_is_full(pman_page_stack_t *pstack);
+void                pman_page_stack_init(pman_page_stack_t *pstack);
+pman_stack_entry_t *pman_page_stack_push(pman_page_stack_t *pstack, pman_stack_entry_t *pentry);
+int                 pman_page_stack_pop(pman_page_stack_t *pstack, pman_stack_entry_t *pentry);
+pman_stack_entry_t *pman_page_stack_top(pman_page_stack_t *pstack);
+pman_stack_entry_t *pman_page_stack_at(pman_page_stack_t *pstack, size_t depth);
+size_t              pman_page_stack_size(pman_page_stack_t *pstack);
+int                 pman_page_stack_find(pman_page_stack_t *pstack, int id);
+int                 pman_page_stack_dequeue(pman_page_stack_t *pstack, pman_stack_entry_t *pentry);
+uint8_t             pman_page_stack_is_empty(pman_page_stack_t *pstack);
+uint8_t             pman_page_stack_is_full(pman_page_stack_t *pstack);
+size_t              pman_page_stack_peak(pman_page_stack_t *pstack, uint8_t reset);
+#ifndef PMAN_PAGE_STACK_DEPTH
+void pman_page_stack_set_allocator(pman_page_stack_t *pstack, void *(*realloc_fn)(void *ptr, size_t size),
+                                   void (*free_fn)(void *ptr));
+int  pman_page_stack_shrink_to_fit(pman_page_stack_t *pstack);
+void pman_page_stack_deinit(pman_page_stack_t *pstack);
+#endif
 
 
 #endif
@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include "state_cache.h"
+
+
+#if PMAN_STATE_CACHE_SIZE > 0
+
+
+static void remove_entry(pman_state_cache_t *cache, size_t index, pman_stack_entry_t *pentry);
+
+
+void pman_state_cache_init(pman_state_cache_t *cache) {
+    cache->num   = 0;
+    cache->bytes = 0;
+    cache->clock = 0;
+}
+
+
+/**
+ * @brief Checks whether an entry must be evicted before a state of the given size can be cached
+ *
+ * @param cache
+ * @param size
+ * @return uint8_t
+ */
+uint8_t pman_state_cache_needs_room(pman_state_cache_t *cache, size_t size) {
+    if (cache->num == 0) {
+        return 0;
+    }
+    if (cache->num == PMAN_STATE_CACHE_SIZE) {
+        return 1;
+    }
+#if PMAN_STATE_CACHE_BUDGET > 0
+    if (cache->bytes + size > PMAN_STATE_CACHE_BUDGET) {
+        return 1;
+    }
+#else
+    (void)size;
+#endif
+    return 0;
+}
+
+
+/**
+ * @brief Adds a page to the cache; there must be room for it (see `pman_state_cache_needs_room`)
+ *
+ * @param cache
+ * @param pentry
+ */
+void pman_state_cache_insert(pman_state_cache_t *cache, pman_stack_entry_t *pentry) {
+    if (cache->num == PMAN_STATE_CACHE_SIZE) {
+        return;
+    }
+
+    pman_state_cache_entry_t *entry = &cache->items[cache->num++];
+    entry->page                     = *pentry;
+    entry->last_used                = cache->clock++;
+    cache->bytes += PMAN_ENTRY_PAGE(pentry)->state_size;
+}
+
+
+/**
+ * @brief Removes the most recently cached page with the given id
+ *
+ * @param cache
+ * @param id
+ * @param pentry where the cached page is copied
+ * @return int 0 if the page was found, -1 otherwise
+ */
+int pman_state_cache_take(pman_state_cache_t *cache, int id, pman_stack_entry_t *pentry) {
+    size_t found = cache->num;
+
+    for (size_t i = 0; i < cache->num; i++) {
+        if (PMAN_ENTRY_PAGE(&cache->items[i].page)->id == id &&
+            (found == cache->num || cache->items[i].last_used > cache->items[found].last_used)) {
+            found = i;
+        }
+    }
+
+    if (found == cache->num) {
+        return -1;
+    }
+
+    remove_entry(cache, found, pentry);
+    return 0;
+}
+
+
+/**
+ * @brief Tells whether the state of a stack entry is parked in the cache; it keeps its instance when taken back
+ *
+ * @param cache
+ * @param instance
+ * @return uint8_t
+ */
+uint8_t pman_state_cache_contains(pman_state_cache_t *cache, uint32_t instance) {
+    for (size_t i = 0; i < cache->num; i++) {
+        if (cache->items[i].page.instance == instance) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Removes the least recently used page from the cache
+ *
+ * @param cache
+ * @param pentry where the evicted page is copied
+ * @return int 0 if a page was evicted, -1 if the cache is empty
+ */
+int pman_state_cache_evict(pman_state_cache_t *cache, pman_stack_entry_t *pentry) {
+    if (cache->num == 0) {
+        return -1;
+    }
+
+    size_t oldest = 0;
+    for (size_t i = 1; i < cache->num; i++) {
+        if (cache->items[i].last_used < cache->items[oldest].last_used) {
+            oldest = i;
+        }
+    }
+
+    remove_entry(cache, oldest, pentry);
+    return 0;
+}
+
+
+static void remove_entry(pman_state_cache_t *cache, size_t index, pman_stack_entry_t *pentry) {
+    if (pentry) {
+        *pentry = cache->items[index].page;
+    }
+    cache->bytes -= PMAN_ENTRY_PAGE(&cache->items[index].page)->state_size;
+    // Order is kept by the LRU clock, so the last item can fill the hole
+    cache->items[index] = cache->items[--cache->num];
+}
+
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PMAN_STATE_CACHE_H_INCLUDED
+#define PMAN_STATE_CACHE_H_INCLUDED
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "page_manager_conf.h"
+#include "page.h"
+
+
+#if PMAN_STATE_CACHE_SIZE > 0
+typedef struct {
+    pman_stack_entry_t page;
+    uint32_t           last_used;
+} pman_state_cache_entry_t;
+
+
+/**
+ * @brief Bounded LRU cache of destroyed page states, keyed by page id
+ *
+ */
+typedef struct {
+    size_t                   num;
+    size_t                   bytes;
+    uint32_t                 clock;
+    pman_state_cache_entry_t items[PMAN_STATE_CACHE_SIZE];
+} pman_state_cache_t;
+
+
+void    pman_state_cache_init(pman_state_cache_t *cache);
+uint8_t pman_state_cache_needs_room(pman_state_cache_t *cache, size_t size);
+void    pman_state_cache_insert(pman_state_cache_t *cache, pman_stack_entry_t *pentry);
+int     pman_state_cache_take(pman_state_cache_t *cache, int id, pman_stack_entry_t *pentry);
+uint8_t pman_state_cache_contains(pman_state_cache_t *cache, uint32_t instance);
+int     pman_state_cache_evict(pman_state_cache_t *cache, pman_stack_entry_t *pentry);
+#endif
+
+
+#endif
@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <string.h>
+#include "stats.h"
+
+
+#if PMAN_STATS_MAX_PAGES > 0
+
+
+void pman_stats_init(pman_stats_t *stats, uint32_t (*clock)(void)) {
+    stats->num   = 0;
+    stats->clock = clock;
+}
+
+
+/**
+ * @brief Zeroes all counters. Pages keep their slot, so references to it stay valid
+ *
+ * @param stats
+ */
+void pman_stats_reset(pman_stats_t *stats) {
+    uint32_t now = pman_stats_now(stats);
+
+    for (size_t i = 0; i < stats->num; i++) {
+        pman_page_stats_t *page    = &stats->items[i];
+        int                id      = page->id;
+        uint8_t            is_open = page->is_open;
+
+        memset(page, 0, sizeof(*page));
+        page->id         = id;
+        page->is_open    = is_open;
+        page->open_since = now;
+    }
+}
+
+
+/**
+ * @brief Finds the counters of a page id, adding them if it was never seen before
+ *
+ * @param stats
+ * @param id
+ * @return pman_page_stats_t* NULL if the table is full
+ */
+pman_page_stats_t *pman_stats_get(pman_stats_t *stats, int id) {
+    for (size_t i = 0; i < stats->num; i++) {
+        if (stats->items[i].id == id) {
+            return &stats->items[i];
+        }
+    }
+
+    if (stats->num == PMAN_STATS_MAX_PAGES) {
+        return NULL;
+    }
+
+    pman_page_stats_t *page = &stats->items[stats->num++];
+    memset(page, 0, sizeof(*page));
+    page->id = id;
+    return page;
+}
+
+
+uint32_t pman_stats_now(pman_stats_t *stats) {
+    return stats->clock != NULL ? stats->clock() : 0;
+}
+
+
+void pman_stats_add_time(pman_stats_timing_t *timing, uint32_t start, uint32_t end) {
+    uint32_t elapsed = end - start;
+
+    timing->calls++;
+    timing->total += elapsed;
+    if (elapsed > timing->max) {
+        timing->max = elapsed;
+    }
+}
+
+
+#endif
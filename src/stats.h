@@ -0,0 +1,70 @@
+#ifndef PMAN_STATS_H_INCLUDED
+#define PMAN_STATS_H_INCLUDED
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "page_manager_conf.h"
+#include "page.h"
+
+
+#if PMAN_STATS_MAX_PAGES > 0
+#define PMAN_STATS_EVENT_TAGS     PMAN_EVENT_TAG_NUM
+#define PMAN_STATS_STACK_MSG_TAGS (PMAN_STACK_MSG_TAG_PRELOAD + 1)
+
+
+/**
+ * @brief Time spent in a page callback, in units of the statistics clock
+ *
+ */
+typedef struct {
+    uint32_t calls;
+    uint32_t total;
+    uint32_t max;
+} pman_stats_timing_t;
+
+
+/**
+ * @brief Counters of a page id, accumulated over all of its instances
+ *
+ */
+typedef struct pman_page_stats {
+    int id;
+
+    uint32_t            opens;
+    pman_stats_timing_t create;
+    pman_stats_timing_t open;
+    pman_stats_timing_t process_event;
+    // Events passed to `process_event`, by tag
+    uint32_t events[PMAN_STATS_EVENT_TAGS];
+    // Stack messages returned by `process_event`, by tag
+    uint32_t stack_msgs[PMAN_STATS_STACK_MSG_TAGS];
+    // Time spent open (on top of the stack)
+    uint32_t resident_time;
+
+    // Start of the current residency, if the page is open
+    uint32_t open_since;
+    uint8_t  is_open;
+} pman_page_stats_t;
+
+
+/**
+ * @brief Statistics of up to PMAN_STATS_MAX_PAGES page ids, in order of first appearance
+ *
+ */
+typedef struct {
+    size_t            num;
+    uint32_t (*clock)(void);
+    pman_page_stats_t items[PMAN_STATS_MAX_PAGES];
+} pman_stats_t;
+
+
+void               pman_stats_init(pman_stats_t *stats, uint32_t (*clock)(void));
+void               pman_stats_reset(pman_stats_t *stats);
+pman_page_stats_t *pman_stats_get(pman_stats_t *stats, int id);
+uint32_t           pman_stats_now(pman_stats_t *stats);
+void               pman_stats_add_time(pman_stats_timing_t *timing, uint32_t start, uint32_t end);
+#endif
+
+
+#endif
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include "trace.h"
+
+
+#if PMAN_TRACE_SIZE > 0
+#ifndef PMAN_EXCLUDE_LVGL
+#include "lvgl.h"
+#endif
+
+
+#define MASK (PMAN_TRACE_SIZE - 1)
+
+// Binary dump layout (little endian): "PMTR", version, record size and two reserved bytes; then each record as 64 bit
+// timestamp, 32 bit sequence number, 32 bit page id, kind, phase, event tag and a reserved byte, until the end of the
+// output
+#define BINARY_VERSION     2
+#define BINARY_HEADER_SIZE 8
+#define BINARY_RECORD_SIZE 20
+
+
+static uint8_t  read_record(pman_trace_t *trace, size_t position, pman_trace_record_t *record);
+static size_t   first_record(pman_trace_t *trace, size_t *count);
+static uint64_t default_clock(void);
+static void     write_u32(char *buffer, uint32_t value);
+
+
+static const char *const kind_names[] = {
+    "create",          "destroy",         "open",         "close",     "process_event",
+    "close_global_cb", "event_global_cb", "user_msg_cb",  "build_step", "revalidate",
+    "serialize",       "deserialize",     "coalesce_key", "coalesce",   "job_discard",
+};
+
+
+void pman_trace_init(pman_trace_t *trace) {
+    for (size_t i = 0; i < PMAN_TRACE_SIZE; i++) {
+        atomic_init(&trace->slots[i].published, 0);
+        for (size_t j = 0; j < 4; j++) {
+            atomic_init(&trace->slots[i].words[j], 0);
+        }
+    }
+    atomic_init(&trace->head, 0);
+    atomic_init(&trace->enabled, 1);
+    trace->clock_us = default_clock;
+}
+
+
+/**
+ * @brief Adds a record to the trace ring, overwriting the oldest one when it is full. Must be called from the UI
+ * thread; the slot is marked as being written until the record is complete, so that readers never see it torn.
+ *
+ * @param trace
+ * @param kind
+ * @param phase
+ * @param page_id
+ * @param event_tag PMAN_TRACE_NO_EVENT if the record does not refer to an event
+ */
+void pman_trace_record(pman_trace_t *trace, pman_trace_kind_t kind, pman_trace_phase_t phase, int page_id,
+                       uint8_t event_tag) {
+    if (!atomic_load_explicit(&trace->enabled, memory_order_relaxed)) {
+        return;
+    }
+
+    size_t             position = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    pman_trace_slot_t *slot     = &trace->slots[position & MASK];
+
+    uint64_t timestamp = trace->clock_us();
+
+    atomic_store_explicit(&slot->published, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->words[0], (uint32_t)timestamp, memory_order_relaxed);
+    atomic_store_explicit(&slot->words[1], (uint32_t)(timestamp >> 32), memory_order_relaxed);
+    atomic_store_explicit(&slot->words[2], (uint32_t)page_id, memory_order_relaxed);
+    atomic_store_explicit(&slot->words[3], (uint32_t)kind | ((uint32_t)phase << 8) | ((uint32_t)event_tag << 16),
+                          memory_order_relaxed);
+
+    atomic_store_explicit(&slot->published, position + 1, memory_order_release);
+    atomic_store_explicit(&trace->head, position + 1, memory_order_release);
+}
+
+
+/**
+ * @brief Sets the clock used to timestamp records. By default it is the LVGL tick (with millisecond resolution), or
+ * nothing without LVGL.
+ *
+ * @param trace
+ * @param clock_us returns the current time in microseconds
+ */
+void pman_trace_set_clock(pman_trace_t *trace, uint64_t (*clock_us)(void)) {
+    trace->clock_us = clock_us != NULL ? clock_us : default_clock;
+}
+
+
+/**
+ * @brief Pauses or resumes tracing. Reading while tracing is active is safe, but the oldest records may be overwritten
+ * (and skipped) in the meantime.
+ *
+ * @param trace
+ * @param value
+ */
+void pman_trace_set_enabled(pman_trace_t *trace, uint8_t value) {
+    atomic_store_explicit(&trace->enabled, value, memory_order_relaxed);
+}
+
+
+void pman_trace_clear(pman_trace_t *trace) {
+    atomic_store_explicit(&trace->head, 0, memory_order_release);
+}
+
+
+/**
+ * @brief Copies the most recent records, oldest first
+ *
+ * @param trace
+ * @param buffer
+ * @param num size of the buffer
+ * @return size_t number of records copied
+ */
+size_t pman_trace_read(pman_trace_t *trace, pman_trace_record_t *buffer, size_t num) {
+    size_t count  = 0;
+    size_t first  = first_record(trace, &count);
+    size_t copied = 0;
+
+    if (count > num) {
+        first += count - num;
+        count = num;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (read_record(trace, first + i, &buffer[copied])) {
+            copied++;
+        }
+    }
+
+    return copied;
+}
+
+
+/**
+ * @brief Writes the records in the Chrome trace event format (JSON), which can be loaded by chrome://tracing or
+ * Perfetto
+ *
+ * @param trace
+ * @param write called with consecutive chunks of the output
+ * @param arg passed to `write`
+ */
+void pman_trace_dump_json(pman_trace_t *trace, void (*write)(const char *data, size_t len, void *arg), void *arg) {
+    char   line[192];
+    size_t count   = 0;
+    size_t first   = first_record(trace, &count);
+    size_t written = 0;
+
+    write("{\"traceEvents\":[", 16, arg);
+    for (size_t i = 0; i < count; i++) {
+        pman_trace_record_t record;
+        if (!read_record(trace, first + i, &record)) {
+            continue;
+        }
+
+        const char *name =
+            record.kind < sizeof(kind_names) / sizeof(kind_names[0]) ? kind_names[record.kind] : "unknown";
+
+        int len = snprintf(line, sizeof(line),
+                           "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":0,\"tid\":0,"
+                           "\"args\":{\"seq\":%lu,\"page\":%ld,\"event\":%d}}",
+                           written > 0 ? "," : "", name, record.phase == PMAN_TRACE_PHASE_BEGIN ? 'B' : 'E',
+                           (unsigned long long)record.timestamp, (unsigned long)record.sequence,
+                           (long)record.page_id, record.event_tag == PMAN_TRACE_NO_EVENT ? -1 : (int)record.event_tag);
+        if (len > 0) {
+            write(line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1, arg);
+            written++;
+        }
+    }
+    write("]}", 2, arg);
+}
+
+
+/**
+ * @brief Writes the records in a compact binary format
+ *
+ * @param trace
+ * @param write called with consecutive chunks of the output
+ * @param arg passed to `write`
+ */
+void pman_trace_dump_binary(pman_trace_t *trace, void (*write)(const char *data, size_t len, void *arg), void *arg) {
+    char   buffer[BINARY_RECORD_SIZE];
+    size_t count = 0;
+    size_t first = first_record(trace, &count);
+
+    buffer[0] = 'P';
+    buffer[1] = 'M';
+    buffer[2] = 'T';
+    buffer[3] = 'R';
+    buffer[4] = BINARY_VERSION;
+    buffer[5] = BINARY_RECORD_SIZE;
+    buffer[6] = 0;
+    buffer[7] = 0;
+    write(buffer, BINARY_HEADER_SIZE, arg);
+
+    for (size_t i = 0; i < count; i++) {
+        pman_trace_record_t record;
+        if (!read_record(trace, first + i, &record)) {
+            continue;
+        }
+
+        write_u32(&buffer[0], (uint32_t)record.timestamp);
+        write_u32(&buffer[4], (uint32_t)(record.timestamp >> 32));
+        write_u32(&buffer[8], record.sequence);
+        write_u32(&buffer[12], (uint32_t)record.page_id);
+        buffer[16] = (char)record.kind;
+        buffer[17] = (char)record.phase;
+        buffer[18] = (char)record.event_tag;
+        buffer[19] = 0;
+        write(buffer, BINARY_RECORD_SIZE, arg);
+    }
+}
+
+
+/**
+ * @brief Copies a record out of the ring, unless it was overwritten before or while being copied
+ *
+ * @param trace
+ * @param position
+ * @param record
+ * @return uint8_t whether the copy is a complete record made at `position`
+ */
+static uint8_t read_record(pman_trace_t *trace, size_t position, pman_trace_record_t *record) {
+    pman_trace_slot_t *slot = &trace->slots[position & MASK];
+
+    if (atomic_load_explicit(&slot->published, memory_order_acquire) != position + 1) {
+        return 0;
+    }
+    uint32_t words[4];
+    for (size_t i = 0; i < 4; i++) {
+        words[i] = atomic_load_explicit(&slot->words[i], memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    *record = (pman_trace_record_t){
+        .timestamp = ((uint64_t)words[1] << 32) | words[0],
+        .sequence  = (uint32_t)position,
+        .page_id   = (int32_t)words[2],
+        .kind      = (uint8_t)words[3],
+        .phase     = (uint8_t)(words[3] >> 8),
+        .event_tag = (uint8_t)(words[3] >> 16),
+    };
+
+    return atomic_load_explicit(&slot->published, memory_order_relaxed) == position + 1;
+}
+
+
+/**
+ * @brief Finds the oldest record still in the ring
+ *
+ * @param trace
+ * @param count set to the number of records available
+ * @return size_t position of the oldest record
+ */
+static size_t first_record(pman_trace_t *trace, size_t *count) {
+    size_t end = atomic_load_explicit(&trace->head, memory_order_acquire);
+
+    *count = end < PMAN_TRACE_SIZE ? end : PMAN_TRACE_SIZE;
+    return end - *count;
+}
+
+
+static uint64_t default_clock(void) {
+#ifndef PMAN_EXCLUDE_LVGL
+    // The millisecond tick wraps after about 49 days; records are only made on the UI thread, so it can be extended
+    // to 64 bits here
+    static uint32_t last  = 0;
+    static uint64_t wraps = 0;
+
+    uint32_t now = lv_tick_get();
+    if (now < last) {
+        wraps++;
+    }
+    last = now;
+
+    return ((wraps << 32) + now) * 1000;
+#else
+    return 0;
+#endif
+}
+
+
+static void write_u32(char *buffer, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        buffer[i] = (char)(value >> (i * 8));
+    }
+}
+
+
+#endif
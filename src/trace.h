@@ -0,0 +1,105 @@
+#ifndef PMAN_TRACE_H_INCLUDED
+#define PMAN_TRACE_H_INCLUDED
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "page_manager_conf.h"
+
+
+typedef enum {
+    PMAN_TRACE_KIND_CREATE = 0,
+    PMAN_TRACE_KIND_DESTROY,
+    PMAN_TRACE_KIND_OPEN,
+    PMAN_TRACE_KIND_CLOSE,
+    PMAN_TRACE_KIND_PROCESS_EVENT,
+    PMAN_TRACE_KIND_CLOSE_GLOBAL_CB,
+    PMAN_TRACE_KIND_EVENT_GLOBAL_CB,
+    PMAN_TRACE_KIND_USER_MSG_CB,
+    PMAN_TRACE_KIND_BUILD_STEP,
+    PMAN_TRACE_KIND_REVALIDATE,
+    PMAN_TRACE_KIND_SERIALIZE,
+    PMAN_TRACE_KIND_DESERIALIZE,
+    PMAN_TRACE_KIND_COALESCE_KEY,
+    PMAN_TRACE_KIND_COALESCE,
+    PMAN_TRACE_KIND_JOB_DISCARD,
+} pman_trace_kind_t;
+
+
+typedef enum {
+    PMAN_TRACE_PHASE_BEGIN = 0,
+    PMAN_TRACE_PHASE_END,
+} pman_trace_phase_t;
+
+
+// Event tag of records that do not refer to an event
+#define PMAN_TRACE_NO_EVENT 0xFF
+// Page id of records of global callbacks
+#define PMAN_TRACE_NO_PAGE -1
+
+
+#if PMAN_TRACE_SIZE > 0
+#include <stdatomic.h>
+
+#if (PMAN_TRACE_SIZE & (PMAN_TRACE_SIZE - 1)) != 0
+#error "PMAN_TRACE_SIZE must be a power of 2"
+#endif
+
+
+typedef struct {
+    // Microseconds, from the clock set with `pman_set_trace_clock`
+    uint64_t timestamp;
+    // Number of records made before this one since the trace was cleared; gaps mark overwritten records
+    uint32_t sequence;
+    int32_t  page_id;
+    uint8_t  kind;
+    uint8_t  phase;
+    uint8_t  event_tag;
+} pman_trace_record_t;
+
+
+typedef struct {
+    // Sequence number plus one of the record in the slot once it is complete, 0 while it is written
+    atomic_size_t published;
+    // Timestamp (low and high half), page id and kind, phase and event tag packed in 32 bit words, so that they can be
+    // copied while being overwritten without tearing a word
+    atomic_uint   words[4];
+} pman_trace_slot_t;
+
+
+/**
+ * @brief Ring of the most recent trace records of a page manager. Records are made on the UI thread and can be read
+ * from any thread: a record overwritten while it is read is skipped.
+ *
+ */
+typedef struct {
+    pman_trace_slot_t slots[PMAN_TRACE_SIZE];
+    // Number of records made since the trace was cleared
+    atomic_size_t head;
+    atomic_uint   enabled;
+    uint64_t (*clock_us)(void);
+} pman_trace_t;
+
+
+#define PMAN_TRACE(pman, kind, phase, page_id, event_tag)                                                              \
+    pman_trace_record(&(pman)->trace, PMAN_TRACE_KIND_##kind, PMAN_TRACE_PHASE_##phase, page_id, event_tag)
+
+
+void   pman_trace_init(pman_trace_t *trace);
+void   pman_trace_record(pman_trace_t *trace, pman_trace_kind_t kind, pman_trace_phase_t phase, int page_id,
+                         uint8_t event_tag);
+void   pman_trace_set_clock(pman_trace_t *trace, uint64_t (*clock_us)(void));
+void   pman_trace_set_enabled(pman_trace_t *trace, uint8_t value);
+void   pman_trace_clear(pman_trace_t *trace);
+size_t pman_trace_read(pman_trace_t *trace, pman_trace_record_t *records, size_t num);
+void   pman_trace_dump_json(pman_trace_t *trace, void (*write)(const char *data, size_t len, void *arg), void *arg);
+void   pman_trace_dump_binary(pman_trace_t *trace, void (*write)(const char *data, size_t len, void *arg), void *arg);
+
+#else
+
+#define PMAN_TRACE(pman, kind, phase, page_id, event_tag)
+
+#endif
+
+
+#endif